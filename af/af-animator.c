@@ -20,22 +20,170 @@
 #include <gtk/gtk.h>
 #include <gobject/gvaluecollector.h>
 #include <string.h>
+#include <math.h>
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
 
 #include "af-animator.h"
 #include "af-timeline.h"
+#include "af-private.h"
 
-static GHashTable *animators = NULL;
 static GHashTable *transformable_types = NULL;
-static guint id_count = 0;
+static GHashTable *in_place_types = NULL;
+
+/* bumped on every registry change, so property ranges
+ * know when their resolved functions went stale.
+ */
+static guint registry_generation = 1;
+
+/* Animator IDs are generational handles into a table of slots:
+ * the low bits hold the slot index, the high bits the generation
+ * the slot had when the animator was added. Releasing a slot bumps
+ * its generation, so stale IDs never resolve to a newer animator.
+ * Slots whose generation runs out are retired instead of reused.
+ */
+#define HANDLE_INDEX_BITS   20
+#define HANDLE_INDEX_MASK   ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_MAX_GEN      (G_MAXUINT >> HANDLE_INDEX_BITS)
+#define HANDLE_NO_SLOT      G_MAXUINT
+
+#define HANDLE_INDEX(id)    ((id) & HANDLE_INDEX_MASK)
+#define HANDLE_GEN(id)      ((id) >> HANDLE_INDEX_BITS)
 
 typedef struct AfPropertyRange AfPropertyRange;
+typedef struct AfLocationRange AfLocationRange;
 typedef struct AfAnimator AfAnimator;
+typedef struct AfAnimatorSlot AfAnimatorSlot;
+typedef struct AfAnimatorTarget AfAnimatorTarget;
+typedef struct AfFrozenTarget AfFrozenTarget;
+typedef struct AfEvaluateJob AfEvaluateJob;
+typedef struct AfSpring AfSpring;
+typedef struct AfSpringState AfSpringState;
+
+struct AfAnimatorSlot
+{
+  AfAnimator *animator;
+  guint generation;
+  guint next_free;
+};
+
+static GArray *animator_slots = NULL;
+static guint free_slot = HANDLE_NO_SLOT;
+
+typedef struct AfCommandNode AfCommandNode;
+
+struct AfCommandNode
+{
+  AfCommandNode *next;
+  guint id;
+  AfAnimatorCommand command;
+  gdouble value;
+
+  /* RETARGET payload */
+  gchar *property_name;
+  GValue target;
+};
+
+/* Commands posted from any thread. Producers push onto the head
+ * of a lock-free stack, the main loop takes the whole stack at
+ * once, at the start of every frame or as soon as it wakes up,
+ * and runs it in posting order.
+ */
+static AfCommandNode * volatile command_queue = NULL;
+static volatile gsize command_source_attached = 0;
 
 struct AfPropertyRange
 {
   GParamSpec *pspec;
   GValue from;
   GValue to;
+
+  /* Setter resolved when the property is added, so frames
+   * bypass the by-name lookups. NULL means going through
+   * g_object_set_property() or gtk_container_child_set_property().
+   */
+  GObjectClass *object_class;
+  GtkContainerClass *container_class;
+  guint param_id;
+
+  /* slot in the animator numeric tracks, or -1 */
+  gint track;
+
+  /* Function given for this property, if any, and the one
+   * resolved from it or the registry for registry_generation.
+   */
+  AfTypeTransformationFunc func;
+  AfTypeTransformationFunc trans_func;
+  AfTypeInPlaceTransformationFunc in_place_func;
+  guint registry_generation;
+
+  /* Weight of the velocity term added to numeric values once
+   * retargeted, so the motion carries on without a kink.
+   */
+  gdouble velocity_offset;
+
+  /* Output slot, reused on every frame, and the buffer
+   * in-place transformations write boxed values to. staged
+   * is set once the frame value is evaluated into it.
+   */
+  GValue value;
+  gpointer boxed;
+  guint staged : 1;
+};
+
+/* Numeric value in caller owned memory, written to directly,
+ * without GValues nor property setters involved.
+ */
+struct AfLocationRange
+{
+  gpointer location;
+  GType type;
+  gdouble from;
+  gdouble to;
+
+  /* slot in the animator numeric tracks, and frame value */
+  gint track;
+  gdouble value;
+};
+
+/* Springs are simulated in fixed steps of SPRING_STEP_USEC, and
+ * frames interpolate between the last two steps, so the motion
+ * does not depend on the frame rate. Time comes from the animator
+ * timeline, whose duration caps how long a spring may take.
+ */
+#define SPRING_STEP_USEC      4000
+#define SPRING_MAX_DELTA_USEC 100000
+
+/* A spring is at rest once within SPRING_REST_RATIO of the
+ * distance it had to travel, and slower than that per 1/10s.
+ */
+#define SPRING_REST_RATIO     1e-3
+#define SPRING_REST_MIN       1e-6
+
+struct AfSpringState
+{
+  gdouble position;
+  gdouble velocity;
+  gdouble previous;
+  gdouble target;
+  gdouble rest_distance;
+};
+
+struct AfSpring
+{
+  gdouble stiffness;
+  gdouble damping;
+  gdouble mass;
+
+  /* animator time of the last step, in usecs */
+  gdouble time;
+
+  /* an AfSpringState per property */
+  GArray *states;
+
+  guint started : 1;
+  guint at_rest : 1;
 };
 
 struct AfTransition
@@ -43,18 +191,183 @@ struct AfTransition
   gdouble from;
   gdouble to;
   AfTimelineProgressType type;
-  AfTypeTransformationFunc func;
 
   GObject *object;
   GObject *child;
   GArray *properties;
+
+  /* memory locations, object is NULL for these */
+  GArray *locations;
+  AfLocationChangedFunc changed_func;
+  gpointer changed_data;
+
+  /* keyframes of the only property, if any, sorted by
+   * progress, and the segment evaluated last.
+   */
+  GArray *keyframes;
+  guint keyframe_cursor;
+
+  /* spring driving all properties, if any */
+  AfSpring *spring;
+
+  /* position in the start ordered index, and insertion
+   * order to keep sorting stable on equal progresses.
+   */
+  guint index;
+  guint seq;
+  guint pending : 1;
+  guint has_from : 1;
+  guint retargeted : 1;
+
+  /* slice of the animator numeric tracks */
+  guint first_track;
+  guint n_tracks;
+
+  /* position in the animator targets, or NO_TARGET */
+  guint target;
+};
+
+#define NO_TARGET G_MAXUINT
+
+#define NOT_PENDING G_MAXUINT
+
+enum {
+  TARGET_OBJECT,
+  TARGET_CHILD,
+  TARGET_LOCATIONS
+};
+
+/* What a frame writes to: an object, whose notifications get
+ * frozen meanwhile, a child widget for child properties, or
+ * a location change function, called once all are written.
+ * frame tells whether it was collected already in a frame.
+ */
+struct AfAnimatorTarget
+{
+  gpointer object;
+  AfLocationChangedFunc changed_func;
+  guint kind : 2;
+  guint frame;
+};
+
+/* Targets collected for a commit, objects are referenced */
+struct AfFrozenTarget
+{
+  gpointer object;
+  AfLocationChangedFunc changed_func;
+  guint kind;
+  guint pending_index;
+};
+
+/* Frames run in two phases: animator_frame_cb() evaluates the
+ * values of each animator as its timeline ticks, and queues it
+ * here. Once the clock ran all timelines, the commit phase
+ * writes all values out, with notifications on every target
+ * frozen across all animators.
+ */
+static GPtrArray *pending_animators = NULL;
+static GArray *frozen_targets = NULL;
+
+/* location targets are kept apart, as several animators
+ * may share a change function and data.
+ */
+static GArray *frozen_locations = NULL;
+static guint n_location_animators = 0;
+static guint commit_count = 0;
+static gboolean committing = FALSE;
+
+static gint64 evaluate_start = 0;
+static gint64 last_evaluate_time = 0;
+static gint64 last_commit_time = 0;
+
+/* Animators set to parallel evaluation split their active set
+ * in chunks, once it is large enough to pay off.
+ */
+#define PARALLEL_CHUNK_SIZE      256
+#define PARALLEL_MIN_TRANSITIONS (4 * PARALLEL_CHUNK_SIZE)
+
+struct AfEvaluateJob
+{
+  AfAnimator *animator;
+  gdouble progress;
+  guint n_chunks;
+
+  volatile guint next_chunk;
+  volatile guint n_workers;
+  volatile guint allocations;
 };
 
+static GThreadPool *evaluate_pool = NULL;
+static guint n_evaluate_workers = 0;
+static GMutex *evaluate_mutex = NULL;
+static GCond *evaluate_cond = NULL;
+
+#if GLIB_CHECK_VERSION (2, 32, 0)
+static GMutex evaluate_mutex_storage;
+static GCond evaluate_cond_storage;
+#endif
+
+/* Transitions are indexed as in a sweep line: sorted both by
+ * start and by end progress, with a cursor on each array and
+ * the set of transitions whose interval contains the current
+ * progress. A frame only touches the transitions that the
+ * cursors cross, plus the active ones.
+ */
 struct AfAnimator
 {
   AfTimeline *timeline;
-  GPtrArray *transitions;
-  GPtrArray *finished_transitions;
+  AfClock *clock;
+
+  GPtrArray *transitions;         /* sorted by from */
+  GPtrArray *transitions_by_end;  /* sorted by to */
+  GPtrArray *active_transitions;  /* sorted by index */
+
+  /* number of transitions with from < last_progress,
+   * and with to <= last_progress, respectively.
+   */
+  guint start_cursor;
+  guint end_cursor;
+  gdouble last_progress;
+
+  guint seq_count;
+  guint index_dirty : 1;
+  guint parallel    : 1;
+
+  /* Spring transitions, the timeline time of the frame
+   * for them, and whether the timeline was sent to its end
+   * because all of them came to rest.
+   */
+  guint n_springs;
+  guint settled     : 1;
+  gdouble spring_time;
+
+  /* timeline progress of the frame being evaluated */
+  gdouble frame_progress;
+
+  /* allocations done by the animator in the last frame */
+  guint frame_allocations;
+
+  /* distinct transition targets */
+  GArray *targets;
+
+  /* transitions evaluated this frame, to be committed,
+   * and position in pending_animators, or NOT_PENDING.
+   */
+  GPtrArray *commit_transitions;
+  guint pending_index;
+
+  /* per frame scratch space to ease the active set in one go */
+  GArray *linear_progress;
+  GArray *progress_types;
+
+  /* Numeric properties without a transformation func, laid out
+   * in transition index order, so the active ones can be
+   * interpolated in a single loop.
+   */
+  GArray *tracks_from;
+  GArray *tracks_to;
+  GArray *tracks_progress;
+  GArray *tracks_value;
 
   gpointer user_data;
   GDestroyNotify value_destroy_func;
@@ -74,7 +387,10 @@ af_transition_new (GObject                 *object,
   AfTransition *transition;
 
   transition = g_slice_new0 (AfTransition);
-  transition->object = g_object_ref (object);
+
+  if (object)
+    transition->object = g_object_ref (object);
+
   transition->from = from;
   transition->to = to;
   transition->type = type;
@@ -92,16 +408,38 @@ af_transition_free (AfTransition *transition)
 {
   guint i;
 
-  g_object_unref (transition->object);
+  if (transition->object)
+    g_object_unref (transition->object);
 
   if (transition->child)
     g_object_unref (transition->child);
 
+  if (transition->locations)
+    g_array_free (transition->locations, TRUE);
+
+  if (transition->keyframes)
+    g_array_free (transition->keyframes, TRUE);
+
+  if (transition->spring)
+    {
+      g_array_free (transition->spring->states, TRUE);
+      g_slice_free (AfSpring, transition->spring);
+    }
+
   for (i = 0; i < transition->properties->len; i++)
     {
       AfPropertyRange *property_range;
 
       property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+
+      if (property_range->boxed)
+        g_boxed_free (property_range->pspec->value_type, property_range->boxed);
+
+      if (G_IS_VALUE (&property_range->from))
+        g_value_unset (&property_range->from);
+
+      g_value_unset (&property_range->to);
+      g_value_unset (&property_range->value);
       g_param_spec_unref (property_range->pspec);
     }
 
@@ -116,7 +454,17 @@ af_animator_new (void)
 
   animator = g_slice_new0 (AfAnimator);
   animator->transitions = g_ptr_array_new ();
-  animator->finished_transitions = g_ptr_array_new ();
+  animator->transitions_by_end = g_ptr_array_new ();
+  animator->active_transitions = g_ptr_array_new ();
+  animator->linear_progress = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  animator->progress_types = g_array_new (FALSE, FALSE, sizeof (AfTimelineProgressType));
+  animator->tracks_from = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  animator->tracks_to = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  animator->tracks_progress = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  animator->tracks_value = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  animator->targets = g_array_new (FALSE, FALSE, sizeof (AfAnimatorTarget));
+  animator->commit_transitions = g_ptr_array_new ();
+  animator->pending_index = NOT_PENDING;
 
   animator->user_data = NULL;
   animator->value_destroy_func = NULL;
@@ -129,22 +477,33 @@ af_animator_new (void)
 static void
 af_animator_free (AfAnimator *animator)
 {
+  /* evaluated, but not committed yet */
+  if (animator->pending_index != NOT_PENDING)
+    g_ptr_array_index (pending_animators, animator->pending_index) = NULL;
+
   if (animator->timeline)
     {
       af_timeline_pause (animator->timeline);
       g_object_unref (animator->timeline);
     }
 
+  if (animator->clock)
+    g_object_unref (animator->clock);
+
   g_ptr_array_foreach (animator->transitions,
                        (GFunc) af_transition_free,
                        NULL);
   g_ptr_array_free (animator->transitions, TRUE);
-
-
-  g_ptr_array_foreach (animator->finished_transitions,
-                       (GFunc) af_transition_free,
-                       NULL);
-  g_ptr_array_free (animator->finished_transitions, TRUE);
+  g_ptr_array_free (animator->transitions_by_end, TRUE);
+  g_ptr_array_free (animator->active_transitions, TRUE);
+  g_array_free (animator->linear_progress, TRUE);
+  g_array_free (animator->progress_types, TRUE);
+  g_array_free (animator->tracks_from, TRUE);
+  g_array_free (animator->tracks_to, TRUE);
+  g_array_free (animator->tracks_progress, TRUE);
+  g_array_free (animator->tracks_value, TRUE);
+  g_array_free (animator->targets, TRUE);
+  g_ptr_array_free (animator->commit_transitions, TRUE);
 
   if (animator->value_destroy_func)
     (animator->value_destroy_func) (animator->user_data);
@@ -152,451 +511,2930 @@ af_animator_free (AfAnimator *animator)
   g_slice_free (AfAnimator, animator);
 }
 
-static void
-af_transition_set_progress (AfTransition *transition,
-                            gdouble       progress,
-			    gpointer      user_data)
+static inline AfAnimator *
+animator_lookup (guint id)
 {
-  GValue value = { 0, };
-  GArray *properties;
-  guint i;
-  AfTypeTransformationFunc func;
+  AfAnimatorSlot *slot;
+  guint index;
 
-  properties = transition->properties;
-  progress = af_timeline_calculate_progress (progress, transition->type);
+  index = HANDLE_INDEX (id);
 
-  for (i = 0; i < properties->len; i++)
-    {
-      AfPropertyRange *property_range;
-      gboolean handled = FALSE;
-      GType type;
+  if (G_UNLIKELY (!animator_slots || index >= animator_slots->len))
+    return NULL;
 
-      property_range = &g_array_index (properties, AfPropertyRange, i);
+  slot = &g_array_index (animator_slots, AfAnimatorSlot, index);
 
-      if (G_UNLIKELY (G_VALUE_TYPE (&property_range->from) == G_TYPE_INVALID))
-        {
-          g_value_init (&property_range->from,
-                        property_range->pspec->value_type);
+  if (G_UNLIKELY (slot->generation != HANDLE_GEN (id)))
+    return NULL;
 
-          if (!transition->child)
-            g_object_get_property (transition->object,
-                                   property_range->pspec->name,
-                                   &property_range->from);
-          else
-            gtk_container_child_get_property (GTK_CONTAINER (transition->object),
-                                              GTK_WIDGET (transition->child),
-                                              property_range->pspec->name,
-                                              &property_range->from);
-        }
+  return slot->animator;
+}
 
-      g_value_init (&value, property_range->pspec->value_type);
-      type = property_range->pspec->value_type;
-      
-      func = transition->func;
+static guint
+animator_slot_acquire (AfAnimator *animator)
+{
+  AfAnimatorSlot *slot;
+  guint index;
 
-      if (!func && transformable_types)
-        func = g_hash_table_lookup (transformable_types, GSIZE_TO_POINTER (type));
+  if (G_UNLIKELY (!animator_slots))
+    animator_slots = g_array_new (FALSE, FALSE, sizeof (AfAnimatorSlot));
 
-      if (!func)
-        {
-          switch (type)
-            {
-              case G_TYPE_INT:
-                {
-                  gint from, to, val;
-
-                  from = g_value_get_int (&property_range->from);
-                  to = g_value_get_int (&property_range->to);
-
-                  val = from + ((to - from) * progress);
-                  g_value_set_int (&value, val);
-                  handled = TRUE;
-                }
-
-                break;
-              case G_TYPE_DOUBLE:
-                {
-                  gdouble from, to, val;
-
-                  from = g_value_get_double (&property_range->from);
-                  to = g_value_get_double (&property_range->to);
-
-                  val = from + ((to - from) * progress);
-                  g_value_set_double (&value, val);
-                  handled = TRUE;
-		}
-
-                break;
-              case G_TYPE_FLOAT:
-                {
-                  gfloat from, to, val;
-
-                  from = g_value_get_float (&property_range->from);
-                  to = g_value_get_float (&property_range->to);
-
-                  val = from + ((to - from) * progress);
-                  g_value_set_float (&value, val);
-                  handled = TRUE;
-                }
-
-                break;
-              default:
-                g_warning ("Property of type '%s' not handled", g_type_name (type));
-            }
-        }
-      else
-        {
-          (func) (&property_range->from,
-                  &property_range->to,
-                  progress,
-	          user_data,
-                  &value);
-           handled = TRUE;
-        }
+  if (free_slot != HANDLE_NO_SLOT)
+    {
+      index = free_slot;
+      slot = &g_array_index (animator_slots, AfAnimatorSlot, index);
+      free_slot = slot->next_free;
+    }
+  else
+    {
+      AfAnimatorSlot new_slot = { NULL, 1, HANDLE_NO_SLOT };
 
+      index = animator_slots->len;
 
-      if (handled)
+      if (G_UNLIKELY (index > HANDLE_INDEX_MASK))
         {
-          if (!transition->child)
-            g_object_set_property (transition->object,
-                                   property_range->pspec->name,
-                                   &value);
-          else
-            gtk_container_child_set_property (GTK_CONTAINER (transition->object),
-                                              GTK_WIDGET (transition->child),
-                                              property_range->pspec->name,
-                                              &value);
+          g_critical ("Too many animators");
+          return 0;
         }
 
-      g_value_unset (&value);
+      g_array_append_val (animator_slots, new_slot);
+      slot = &g_array_index (animator_slots, AfAnimatorSlot, index);
     }
+
+  slot->animator = animator;
+
+  return (slot->generation << HANDLE_INDEX_BITS) | index;
 }
 
-static void
-animator_frame_cb (AfTimeline *timeline,
-                   gdouble     progress,
-                   gpointer    user_data)
+/* Detaches the animator from its ID, and returns it
+ * so the caller can free it, or NULL for stale IDs.
+ */
+static AfAnimator *
+animator_slot_release (guint id)
 {
+  AfAnimatorSlot *slot;
   AfAnimator *animator;
-  AfTransition *transition;
-  guint i = 0;
 
-  animator = (AfAnimator *) user_data;
+  animator = animator_lookup (id);
+
+  if (!animator)
+    return NULL;
 
-  while (i < animator->transitions->len)
+  slot = &g_array_index (animator_slots, AfAnimatorSlot, HANDLE_INDEX (id));
+  slot->animator = NULL;
+
+  if (slot->generation < HANDLE_MAX_GEN)
     {
-      gdouble transition_progress;
+      slot->generation++;
+      slot->next_free = free_slot;
+      free_slot = HANDLE_INDEX (id);
+    }
 
-      transition = g_ptr_array_index (animator->transitions, i);
+  return animator;
+}
 
-      if (progress <= transition->from)
-        {
-          i++;
-          continue;
-        }
+static void
+property_range_resolve (AfTransition    *transition,
+                        AfPropertyRange *property_range)
+{
+  GObjectClass *owner_class;
+  GParamSpec *pspec;
+
+  pspec = property_range->pspec;
+
+  /* Interface properties are implemented through overrides,
+   * whose class and id are only known to GObject itself.
+   */
+  if (G_TYPE_IS_INTERFACE (pspec->owner_type))
+    return;
+
+  property_range->param_id = pspec->param_id;
+
+  if (transition->child)
+    {
+      property_range->container_class = g_type_class_peek (pspec->owner_type);
+      return;
+    }
+
+  owner_class = g_type_class_peek (pspec->owner_type);
+
+  /* The same goes for class overrides, which lookups resolve
+   * to the overridden pspec. Only a class below the owner with
+   * a setter of its own can hold one, those go by name.
+   */
+  if (G_OBJECT_GET_CLASS (transition->object)->set_property != owner_class->set_property)
+    return;
+
+  property_range->object_class = owner_class;
+}
+
+static void
+property_range_resolve_func (AfPropertyRange *property_range)
+{
+  GType type;
+
+  type = property_range->pspec->value_type;
+  property_range->trans_func = property_range->func;
+  property_range->in_place_func = NULL;
+
+  if (!property_range->trans_func && in_place_types)
+    property_range->in_place_func = g_hash_table_lookup (in_place_types,
+                                                         GSIZE_TO_POINTER (type));
 
-      transition_progress = progress - transition->from;
-      transition_progress /= (transition->to - transition->from);
-      transition_progress = CLAMP (transition_progress, 0.0, 1.0);
+  if (!property_range->trans_func && !property_range->in_place_func &&
+      transformable_types)
+    property_range->trans_func = g_hash_table_lookup (transformable_types,
+                                                      GSIZE_TO_POINTER (type));
 
-      af_transition_set_progress (transition, 
-		                  transition_progress,
-				  animator->user_data);
+  property_range->registry_generation = registry_generation;
+}
 
-      if (progress >= transition->to)
+static void
+property_range_apply (AfTransition    *transition,
+                      AfPropertyRange *property_range,
+                      GValue          *value)
+{
+  if (!transition->child)
+    {
+      if (G_LIKELY (property_range->object_class))
         {
-          g_ptr_array_remove_index_fast (animator->transitions, i);
-          g_ptr_array_add (animator->finished_transitions, transition);
+          /* as the by-name setters do, easings may overshoot */
+          g_param_value_validate (property_range->pspec, value);
+          (property_range->object_class->set_property) (transition->object,
+                                                        property_range->param_id,
+                                                        value,
+                                                        property_range->pspec);
+          g_object_notify_by_pspec (transition->object, property_range->pspec);
         }
       else
-        i++;
+        g_object_set_property (transition->object,
+                               property_range->pspec->name,
+                               value);
     }
-
-  if (progress == 1.0 &&
-      af_timeline_get_loop (timeline))
+  else
     {
-      /* Animation is about to begin again,
-       * dump all finished transitions back.
+      /* the child might have been moved elsewhere meanwhile,
+       * let the slow path complain about it.
        */
-      while (animator->finished_transitions->len > 0)
+      if (G_LIKELY (property_range->container_class &&
+                    GTK_WIDGET (transition->child)->parent == GTK_WIDGET (transition->object)))
         {
-          transition = g_ptr_array_remove_index_fast (animator->finished_transitions, 0);
-          g_ptr_array_add (animator->transitions, transition);
+          g_param_value_validate (property_range->pspec, value);
+          (property_range->container_class->set_child_property) (GTK_CONTAINER (transition->object),
+                                                                 GTK_WIDGET (transition->child),
+                                                                 property_range->param_id,
+                                                                 value,
+                                                                 property_range->pspec);
+          /* GTK+ 2 only does child notification by name */
+          gtk_widget_child_notify (GTK_WIDGET (transition->child),
+                                   property_range->pspec->name);
         }
+      else
+        gtk_container_child_set_property (GTK_CONTAINER (transition->object),
+                                          GTK_WIDGET (transition->child),
+                                          property_range->pspec->name,
+                                          value);
     }
 }
 
 static gboolean
-transition_add_property (AfTransition            *transition,
-                         GParamSpec              *pspec,
-                         GValue                  *to,
-			 AfTypeTransformationFunc func)
+value_type_is_numeric (GType type)
 {
-  AfPropertyRange property_range = { 0, };
+  return (type == G_TYPE_INT ||
+          type == G_TYPE_UINT ||
+          type == G_TYPE_INT64 ||
+          type == G_TYPE_DOUBLE ||
+          type == G_TYPE_FLOAT);
+}
 
-  if (G_VALUE_TYPE (to) != pspec->value_type)
+static gdouble
+value_get_numeric (const GValue *value)
+{
+  switch (G_VALUE_TYPE (value))
     {
-      g_warning ("Target value type (%s) do not match property type (%s)",
-                 G_VALUE_TYPE_NAME (to),
-                 g_type_name (pspec->value_type));
-      return FALSE;
+    case G_TYPE_INT:
+      return g_value_get_int (value);
+    case G_TYPE_UINT:
+      return g_value_get_uint (value);
+    case G_TYPE_INT64:
+      return g_value_get_int64 (value);
+    case G_TYPE_FLOAT:
+      return g_value_get_float (value);
+    case G_TYPE_DOUBLE:
+    default:
+      return g_value_get_double (value);
     }
+}
 
-  property_range.pspec = g_param_spec_ref (pspec);
-
-  g_value_init (&property_range.to, pspec->value_type);
-  g_value_copy (to, &property_range.to);
+static void
+value_set_numeric (GValue  *value,
+                   gdouble  val)
+{
+  /* integers truncate towards zero, and saturate
+   * if the easing overshoots past the type range.
+   */
+  switch (G_VALUE_TYPE (value))
+    {
+    case G_TYPE_INT:
+      g_value_set_int (value, (gint) CLAMP (val, G_MININT, G_MAXINT));
+      break;
+    case G_TYPE_UINT:
+      g_value_set_uint (value, (guint) CLAMP (val, 0, G_MAXUINT));
+      break;
+    case G_TYPE_INT64:
+      if (val >= (gdouble) G_MAXINT64)
+        g_value_set_int64 (value, G_MAXINT64);
+      else
+        g_value_set_int64 (value, (gint64) MAX (val, (gdouble) G_MININT64));
+      break;
+    case G_TYPE_FLOAT:
+      g_value_set_float (value, (gfloat) val);
+      break;
+    case G_TYPE_DOUBLE:
+    default:
+      g_value_set_double (value, val);
+      break;
+    }
+}
 
-  g_array_append_val (transition->properties, property_range);
+static gdouble
+location_get_numeric (GType    type,
+                      gpointer location)
+{
+  switch (type)
+    {
+    case G_TYPE_INT:
+      return *(gint *) location;
+    case G_TYPE_UINT:
+      return *(guint *) location;
+    case G_TYPE_INT64:
+      return *(gint64 *) location;
+    case G_TYPE_FLOAT:
+      return *(gfloat *) location;
+    case G_TYPE_DOUBLE:
+    default:
+      return *(gdouble *) location;
+    }
+}
 
-  transition->func = func;
+/* same conversions as value_set_numeric() */
+static void
+location_set_numeric (GType    type,
+                      gpointer location,
+                      gdouble  val)
+{
+  switch (type)
+    {
+    case G_TYPE_INT:
+      *(gint *) location = (gint) CLAMP (val, G_MININT, G_MAXINT);
+      break;
+    case G_TYPE_UINT:
+      *(guint *) location = (guint) CLAMP (val, 0, G_MAXUINT);
+      break;
+    case G_TYPE_INT64:
+      if (val >= (gdouble) G_MAXINT64)
+        *(gint64 *) location = G_MAXINT64;
+      else
+        *(gint64 *) location = (gint64) MAX (val, (gdouble) G_MININT64);
+      break;
+    case G_TYPE_FLOAT:
+      *(gfloat *) location = (gfloat) val;
+      break;
+    case G_TYPE_DOUBLE:
+    default:
+      *(gdouble *) location = val;
+      break;
+    }
+}
 
-  return TRUE;
+/* whether setting a value of this type copies it to the heap */
+static gboolean
+value_type_allocates (GType type)
+{
+  return (G_TYPE_FUNDAMENTAL (type) == G_TYPE_STRING ||
+          G_TYPE_FUNDAMENTAL (type) == G_TYPE_BOXED);
 }
 
+/* Fetches the initial values, the first time the transition plays */
 static void
-transition_add_properties (AfTransition *transition,
-                           va_list       args)
+transition_capture_from (AfAnimator   *animator,
+                         AfTransition *transition)
 {
-  const gchar *property_name;
-  GObject *object, *child;
+  GArray *properties;
+  guint i;
 
-  property_name = va_arg (args, const gchar *);
-  object = transition->object;
-  child = transition->child;
+  properties = transition->properties;
 
-  while (property_name)
+  for (i = 0; transition->locations && i < transition->locations->len; i++)
     {
-      GParamSpec *pspec;
-      GValue to = { 0, };
-      GValue func = { 0, };
-      gchar *error = NULL;
-
-      if (!child)
-        pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
-                                              property_name);
-      else
-        pspec = gtk_container_class_find_child_property (G_OBJECT_GET_CLASS (object),
-                                                         property_name);
+      AfLocationRange *location_range;
 
-      if (G_UNLIKELY (!pspec))
-        {
-          g_warning ("Property '%s' does not exist on object of class '%s'",
-                     property_name, G_OBJECT_TYPE_NAME (object));
-          break;
-        }
+      location_range = &g_array_index (transition->locations, AfLocationRange, i);
+      location_range->from = location_get_numeric (location_range->type,
+                                                   location_range->location);
 
-      g_value_init (&to, pspec->value_type);
-      G_VALUE_COLLECT (&to, args, 0, &error);
+      if (location_range->track >= 0)
+        g_array_index (animator->tracks_from, gdouble, location_range->track) =
+          location_range->from;
+    }
 
-      if (error)
-        {
-          g_warning (error);
-          g_free (error);
-          break;
-        }
+  for (i = 0; i < properties->len; i++)
+    {
+      AfPropertyRange *property_range;
 
-      g_value_init (&func, G_TYPE_POINTER);
-      G_VALUE_COLLECT (&func, args, 0, &error);
+      property_range = &g_array_index (properties, AfPropertyRange, i);
 
-      if (error)
+      if (G_VALUE_TYPE (&property_range->from) == G_TYPE_INVALID)
         {
-          g_warning (error);
-          g_free (error);
-          break;
-        }
+          g_value_init (&property_range->from,
+                        property_range->pspec->value_type);
+
+          if (!transition->child)
+            g_object_get_property (transition->object,
+                                   property_range->pspec->name,
+                                   &property_range->from);
+          else
+            gtk_container_child_get_property (GTK_CONTAINER (transition->object),
+                                              GTK_WIDGET (transition->child),
+                                              property_range->pspec->name,
+                                              &property_range->from);
+
+          if (value_type_allocates (property_range->pspec->value_type))
+            animator->frame_allocations++;
+        }
+
+      if (property_range->track >= 0)
+        g_array_index (animator->tracks_from, gdouble, property_range->track) =
+          value_get_numeric (&property_range->from);
+    }
+
+  transition->has_from = TRUE;
+}
+
+static gboolean
+property_range_transform_in_place (AfAnimator                      *animator,
+                                   AfPropertyRange                 *property_range,
+                                   AfTypeInPlaceTransformationFunc  func,
+                                   gdouble                          progress,
+                                   guint                           *allocations)
+{
+  GType type;
+
+  type = property_range->pspec->value_type;
+
+  if (G_UNLIKELY (!property_range->boxed))
+    {
+      gconstpointer to;
+
+      to = g_value_get_boxed (&property_range->to);
+
+      if (!to)
+        {
+          g_warning ("Can not transform NULL values of type '%s' in place",
+                     g_type_name (type));
+          return FALSE;
+        }
+
+      property_range->boxed = g_boxed_copy (type, to);
+      (*allocations)++;
+    }
+
+  (func) (&property_range->from,
+          &property_range->to,
+          progress,
+          animator->user_data,
+          property_range->boxed);
+
+  /* the slot just points to the buffer, no copy done */
+  g_value_set_static_boxed (&property_range->value, property_range->boxed);
+
+  return TRUE;
+}
+
+/* Hermite basis with a unit slope at 0, and flat at 1,
+ * 0 at both ends, and its derivative.
+ */
+static inline gdouble
+velocity_basis (gdouble s)
+{
+  return s * (1 - s) * (1 - s);
+}
+
+static inline gdouble
+velocity_basis_slope (gdouble s)
+{
+  return 1 - 4 * s + 3 * s * s;
+}
+
+static gdouble
+easing_slope (AfTimelineProgressType type,
+              gdouble                s)
+{
+  gdouble a, b;
+
+  a = MAX (s - 1e-4, 0.0);
+  b = MIN (s + 1e-4, 1.0);
+
+  return (_af_easing_calculate (b, type) - _af_easing_calculate (a, type)) / (b - a);
+}
+
+static inline gboolean
+keyframes_segment_contains (const AfKeyframe *keyframes,
+                            guint             n_segments,
+                            guint             segment,
+                            gdouble           progress)
+{
+  /* the first and last segments extend outwards */
+  return ((segment == 0 || keyframes[segment].progress <= progress) &&
+          (segment == n_segments - 1 || progress < keyframes[segment + 1].progress));
+}
+
+/* Finds the segment @progress falls in. Playback only ever moves
+ * to a neighbour of the segment used last, seeks do a binary search.
+ */
+static guint
+keyframes_find_segment (AfTransition *transition,
+                        gdouble       progress)
+{
+  const AfKeyframe *keyframes;
+  guint cursor, n_segments, min, max;
+
+  keyframes = (const AfKeyframe *) transition->keyframes->data;
+  n_segments = transition->keyframes->len - 1;
+  cursor = transition->keyframe_cursor;
+
+  if (keyframes_segment_contains (keyframes, n_segments, cursor, progress))
+    return cursor;
+
+  if (cursor + 1 < n_segments &&
+      keyframes_segment_contains (keyframes, n_segments, cursor + 1, progress))
+    return cursor + 1;
+
+  if (cursor > 0 &&
+      keyframes_segment_contains (keyframes, n_segments, cursor - 1, progress))
+    return cursor - 1;
+
+  /* first keyframe past progress, the segment ends there */
+  min = 1;
+  max = n_segments;
+
+  while (min < max)
+    {
+      guint mid = (min + max) / 2;
+
+      if (keyframes[mid].progress <= progress)
+        min = mid + 1;
+      else
+        max = mid;
+    }
+
+  return min - 1;
+}
+
+static gdouble
+keyframes_evaluate (AfTransition *transition,
+                    gdouble       transition_progress)
+{
+  const AfKeyframe *start, *end;
+  gdouble progress, t;
+  guint segment;
+
+  /* keyframes are in animator progress */
+  progress = transition->from + (transition->to - transition->from) * transition_progress;
+
+  segment = keyframes_find_segment (transition, progress);
+  transition->keyframe_cursor = segment;
+
+  start = &g_array_index (transition->keyframes, AfKeyframe, segment);
+  end = start + 1;
+
+  if (end->progress > start->progress)
+    {
+      t = (progress - start->progress) / (end->progress - start->progress);
+      t = CLAMP (t, 0.0, 1.0);
+    }
+  else
+    t = (progress >= end->progress) ? 1.0 : 0.0;
+
+  return start->value + (end->value - start->value) * _af_easing_calculate (t, end->type);
+}
+
+static void
+spring_state_aim (AfSpringState *state,
+                  gdouble        target)
+{
+  state->target = target;
+  state->rest_distance = MAX (fabs (target - state->position) * SPRING_REST_RATIO,
+                              SPRING_REST_MIN);
+}
+
+static void
+spring_settle (AfSpring *spring)
+{
+  AfSpringState *states;
+  guint i;
+
+  states = (AfSpringState *) spring->states->data;
+
+  for (i = 0; i < spring->states->len; i++)
+    {
+      states[i].position = states[i].previous = states[i].target;
+      states[i].velocity = 0.0;
+    }
+
+  spring->at_rest = TRUE;
+}
+
+/* One semi-implicit Euler step, and whether all came to rest */
+static gboolean
+spring_step (AfSpring *spring)
+{
+  AfSpringState *states;
+  gdouble dt, acceleration;
+  gboolean at_rest = TRUE;
+  guint i;
+
+  states = (AfSpringState *) spring->states->data;
+  dt = (gdouble) SPRING_STEP_USEC / G_USEC_PER_SEC;
+
+  for (i = 0; i < spring->states->len; i++)
+    {
+      AfSpringState *state = &states[i];
+
+      acceleration = (- spring->stiffness * (state->position - state->target)
+                      - spring->damping * state->velocity) / spring->mass;
+
+      state->previous = state->position;
+      state->velocity += acceleration * dt;
+      state->position += state->velocity * dt;
+
+      if (fabs (state->position - state->target) > state->rest_distance ||
+          fabs (state->velocity) > state->rest_distance * 10)
+        at_rest = FALSE;
+    }
+
+  return at_rest;
+}
+
+static void
+spring_evaluate (AfAnimator   *animator,
+                 AfTransition *transition,
+                 gdouble       progress)
+{
+  AfSpring *spring;
+  AfSpringState *states;
+  gdouble time, alpha;
+  guint i;
+
+  spring = transition->spring;
+  states = (AfSpringState *) spring->states->data;
+  time = animator->spring_time;
+
+  if (G_UNLIKELY (!spring->started))
+    {
+      for (i = 0; i < transition->properties->len; i++)
+        {
+          AfPropertyRange *property_range;
+
+          property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+          states[i].position = states[i].previous = value_get_numeric (&property_range->from);
+          states[i].velocity = 0.0;
+          spring_state_aim (&states[i], states[i].target);
+        }
+
+      spring->time = time;
+      spring->started = TRUE;
+    }
+
+  /* out of time, land on the target */
+  if (progress >= 1.0)
+    spring_settle (spring);
+
+  if (!spring->at_rest)
+    {
+      /* long stalls are not replayed in full */
+      if (time - spring->time > SPRING_MAX_DELTA_USEC)
+        spring->time = time - SPRING_MAX_DELTA_USEC;
+
+      while (spring->time < time)
+        {
+          spring->time += SPRING_STEP_USEC;
+
+          if (spring_step (spring))
+            {
+              spring_settle (spring);
+              break;
+            }
+        }
+    }
+
+  /* the last step may run ahead of the frame, go back from it */
+  alpha = 1.0 - (spring->time - time) / SPRING_STEP_USEC;
+  alpha = CLAMP (alpha, 0.0, 1.0);
+
+  for (i = 0; i < transition->properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+
+      property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+      value_set_numeric (&property_range->value,
+                         states[i].previous +
+                         (states[i].position - states[i].previous) * alpha);
+      property_range->staged = TRUE;
+    }
+}
+
+/* Computes the frame values into the property and location
+ * ranges, without writing them out yet. Allocations done are
+ * added to @allocations, as this may run in worker threads.
+ */
+static void
+transition_evaluate (AfAnimator   *animator,
+                     AfTransition *transition,
+                     gdouble       progress,
+                     guint        *allocations)
+{
+  const gdouble *tracks_value;
+  GArray *properties;
+  guint i;
+
+  properties = transition->properties;
+  tracks_value = (const gdouble *) animator->tracks_value->data;
+
+  if (transition->spring)
+    {
+      spring_evaluate (animator, transition, progress);
+      return;
+    }
+
+  for (i = 0; transition->locations && i < transition->locations->len; i++)
+    {
+      AfLocationRange *location_range;
+
+      location_range = &g_array_index (transition->locations, AfLocationRange, i);
+      location_range->value = tracks_value[location_range->track];
+    }
+
+  for (i = 0; i < properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+      GType type;
+
+      property_range = &g_array_index (properties, AfPropertyRange, i);
+      type = property_range->pspec->value_type;
+      property_range->staged = FALSE;
+
+      if (transition->keyframes)
+        {
+          value_set_numeric (&property_range->value,
+                             keyframes_evaluate (transition, progress));
+          property_range->staged = TRUE;
+          continue;
+        }
+
+      if (property_range->track >= 0)
+        {
+          gdouble value;
+
+          value = tracks_value[property_range->track];
+
+          if (G_UNLIKELY (transition->retargeted))
+            {
+              gdouble s;
+
+              s = (animator->frame_progress - transition->from) /
+                  (transition->to - transition->from);
+              value += property_range->velocity_offset *
+                       velocity_basis (CLAMP (s, 0.0, 1.0));
+            }
+
+          value_set_numeric (&property_range->value, value);
+          property_range->staged = TRUE;
+          continue;
+        }
+
+      if (G_UNLIKELY (property_range->registry_generation != registry_generation))
+        property_range_resolve_func (property_range);
+
+      if (property_range->in_place_func)
+        {
+          property_range->staged =
+            property_range_transform_in_place (animator, property_range,
+                                               property_range->in_place_func,
+                                               progress, allocations);
+          continue;
+        }
+
+      if (!property_range->trans_func)
+        {
+          g_warning ("Property of type '%s' not handled", g_type_name (type));
+          continue;
+        }
+
+      (property_range->trans_func) (&property_range->from,
+              &property_range->to,
+              progress,
+              animator->user_data,
+              &property_range->value);
+
+      if (value_type_allocates (type))
+        (*allocations)++;
+
+      property_range->staged = TRUE;
+    }
+}
+
+/* Writes out the values staged by transition_evaluate() */
+static void
+transition_commit (AfTransition *transition)
+{
+  GArray *properties;
+  guint i;
+
+  properties = transition->properties;
+
+  for (i = 0; transition->locations && i < transition->locations->len; i++)
+    {
+      AfLocationRange *location_range;
+
+      location_range = &g_array_index (transition->locations, AfLocationRange, i);
+      location_set_numeric (location_range->type,
+                            location_range->location,
+                            location_range->value);
+    }
+
+  for (i = 0; i < properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+
+      property_range = &g_array_index (properties, AfPropertyRange, i);
+
+      if (property_range->staged)
+        property_range_apply (transition, property_range, &property_range->value);
+    }
+}
+
+static gint
+transition_compare_start (gconstpointer a,
+                          gconstpointer b)
+{
+  const AfTransition *transition_a = *(AfTransition **) a;
+  const AfTransition *transition_b = *(AfTransition **) b;
+
+  if (transition_a->from != transition_b->from)
+    return (transition_a->from < transition_b->from) ? -1 : 1;
+
+  return (gint) transition_a->seq - (gint) transition_b->seq;
+}
+
+static gint
+transition_compare_end (gconstpointer a,
+                        gconstpointer b)
+{
+  const AfTransition *transition_a = *(AfTransition **) a;
+  const AfTransition *transition_b = *(AfTransition **) b;
+
+  if (transition_a->to != transition_b->to)
+    return (transition_a->to < transition_b->to) ? -1 : 1;
+
+  return (gint) transition_a->seq - (gint) transition_b->seq;
+}
+
+static void
+animator_activate_transition (AfAnimator   *animator,
+                              AfTransition *transition)
+{
+  GPtrArray *active;
+  guint min, max;
+
+  active = animator->active_transitions;
+  min = 0;
+  max = active->len;
+
+  /* keep application order stable, whatever the
+   * direction transitions become active in.
+   */
+  while (min < max)
+    {
+      guint mid = (min + max) / 2;
+
+      if (((AfTransition *) g_ptr_array_index (active, mid))->index < transition->index)
+        min = mid + 1;
+      else
+        max = mid;
+    }
+
+  g_ptr_array_set_size (active, active->len + 1);
+  memmove (&active->pdata[min + 1], &active->pdata[min],
+           (active->len - min - 1) * sizeof (gpointer));
+  active->pdata[min] = transition;
+}
+
+static void
+animator_add_transition (AfAnimator   *animator,
+                         AfTransition *transition)
+{
+  transition->seq = animator->seq_count++;
+  transition->pending = TRUE;
+
+  g_ptr_array_add (animator->transitions, transition);
+  g_ptr_array_add (animator->transitions_by_end, transition);
+  animator->index_dirty = TRUE;
+}
+
+/* Lays out numeric tracks in transition index order */
+static void
+animator_tracks_rebuild (AfAnimator *animator)
+{
+  guint i, j, n_tracks;
+
+  n_tracks = 0;
+  g_array_set_size (animator->tracks_from, 0);
+  g_array_set_size (animator->tracks_to, 0);
+
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+
+      transition = g_ptr_array_index (animator->transitions, i);
+      transition->first_track = n_tracks;
+
+      for (j = 0; j < transition->properties->len; j++)
+        {
+          AfPropertyRange *property_range;
+          gdouble from, to;
+          GType type;
+
+          property_range = &g_array_index (transition->properties, AfPropertyRange, j);
+          type = property_range->pspec->value_type;
+          property_range->track = -1;
+
+          if (property_range->registry_generation != registry_generation)
+            property_range_resolve_func (property_range);
+
+          /* keyframes and springs don't fit a from/to track */
+          if (transition->keyframes ||
+              transition->spring ||
+              property_range->trans_func ||
+              !value_type_is_numeric (type))
+            continue;
+
+          to = value_get_numeric (&property_range->to);
+          from = (transition->has_from) ? value_get_numeric (&property_range->from) : to;
+
+          g_array_append_val (animator->tracks_from, from);
+          g_array_append_val (animator->tracks_to, to);
+          property_range->track = n_tracks++;
+        }
+
+      /* locations are always numeric, and always tracked */
+      for (j = 0; transition->locations && j < transition->locations->len; j++)
+        {
+          AfLocationRange *location_range;
+          gdouble from;
+
+          location_range = &g_array_index (transition->locations, AfLocationRange, j);
+          from = (transition->has_from) ? location_range->from : location_range->to;
+
+          g_array_append_val (animator->tracks_from, from);
+          g_array_append_val (animator->tracks_to, location_range->to);
+          location_range->track = n_tracks++;
+        }
+
+      transition->n_tracks = n_tracks - transition->first_track;
+    }
+
+  g_array_set_size (animator->tracks_progress, n_tracks);
+  g_array_set_size (animator->tracks_value, n_tracks);
+}
+
+/* Collects the distinct targets transitions write to, returns
+ * the number of scratch tables it allocated for that.
+ */
+static guint
+animator_targets_rebuild (AfAnimator *animator)
+{
+  GHashTable *tables[3];
+  guint i;
+
+  g_array_set_size (animator->targets, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (tables); i++)
+    tables[i] = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+      AfAnimatorTarget target = { 0, };
+      gpointer index;
+
+      transition = g_ptr_array_index (animator->transitions, i);
+      transition->target = NO_TARGET;
+
+      if (transition->locations)
+        {
+          if (!transition->changed_func)
+            continue;
+
+          target.object = transition->changed_data;
+          target.changed_func = transition->changed_func;
+          target.kind = TARGET_LOCATIONS;
+        }
+      else if (!transition->child)
+        {
+          target.object = transition->object;
+          target.kind = TARGET_OBJECT;
+        }
+      else
+        {
+          target.object = transition->child;
+          target.kind = TARGET_CHILD;
+        }
+
+      /* indices are stored off by one, to tell them from NULL */
+      index = g_hash_table_lookup (tables[target.kind], target.object);
+
+      if (index &&
+          g_array_index (animator->targets, AfAnimatorTarget,
+                         GPOINTER_TO_UINT (index) - 1).changed_func == target.changed_func)
+        {
+          transition->target = GPOINTER_TO_UINT (index) - 1;
+          continue;
+        }
+
+      transition->target = animator->targets->len;
+      g_array_append_val (animator->targets, target);
+
+      /* same data with another change function is rare,
+       * those just get a target of their own.
+       */
+      if (!index)
+        g_hash_table_insert (tables[target.kind], target.object,
+                             GUINT_TO_POINTER (animator->targets->len));
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (tables); i++)
+    g_hash_table_destroy (tables[i]);
+
+  return G_N_ELEMENTS (tables);
+}
+
+#define N_INDEX_ARRAYS 9
+
+static void
+animator_index_arrays (AfAnimator *animator,
+                       gpointer   *data)
+{
+  data[0] = animator->active_transitions->pdata;
+  data[1] = animator->commit_transitions->pdata;
+  data[2] = animator->linear_progress->data;
+  data[3] = animator->progress_types->data;
+  data[4] = animator->tracks_from->data;
+  data[5] = animator->tracks_to->data;
+  data[6] = animator->tracks_progress->data;
+  data[7] = animator->tracks_value->data;
+  data[8] = animator->targets->data;
+}
+
+/* Brings the index back in sync with last_progress after
+ * transitions were added or removed. New transitions the
+ * playback already went past get applied once, as usual.
+ * Returns the number of allocations done.
+ */
+static guint
+animator_index_rebuild (AfAnimator *animator,
+                        gboolean    backward)
+{
+  gpointer before[N_INDEX_ARRAYS], after[N_INDEX_ARRAYS];
+  gdouble progress;
+  guint i, allocations;
+
+  progress = animator->last_progress;
+  animator_index_arrays (animator, before);
+
+  g_ptr_array_sort (animator->transitions, transition_compare_start);
+  g_ptr_array_sort (animator->transitions_by_end, transition_compare_end);
+
+  /* Reserve room for all transitions in the active set and the
+   * per frame scratch arrays, so frames never need to grow them.
+   */
+  g_ptr_array_set_size (animator->active_transitions, animator->transitions->len);
+  g_ptr_array_set_size (animator->active_transitions, 0);
+  g_array_set_size (animator->linear_progress, animator->transitions->len);
+  g_array_set_size (animator->progress_types, animator->transitions->len);
+  g_ptr_array_set_size (animator->commit_transitions, animator->transitions->len);
+  g_ptr_array_set_size (animator->commit_transitions, 0);
+
+  animator->start_cursor = 0;
+  animator->end_cursor = 0;
+
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+
+      transition = g_ptr_array_index (animator->transitions, i);
+      transition->index = i;
+
+      if (transition->from < progress)
+        animator->start_cursor++;
+
+      if ((transition->from < progress && progress < transition->to) ||
+          (transition->pending && !backward && transition->from < progress) ||
+          (transition->pending && backward && transition->to > progress))
+        g_ptr_array_add (animator->active_transitions, transition);
+
+      transition->pending = FALSE;
+    }
+
+  while (animator->end_cursor < animator->transitions_by_end->len &&
+         ((AfTransition *) g_ptr_array_index (animator->transitions_by_end,
+                                              animator->end_cursor))->to <= progress)
+    animator->end_cursor++;
+
+  animator_tracks_rebuild (animator);
+  allocations = animator_targets_rebuild (animator);
+  animator->index_dirty = FALSE;
+
+  /* arrays only reallocate when they outgrow their capacity */
+  animator_index_arrays (animator, after);
+
+  for (i = 0; i < N_INDEX_ARRAYS; i++)
+    if (after[i] != before[i])
+      allocations++;
+
+  return allocations;
+}
+
+/* Starts the sweep over from the beginning of the playback */
+static void
+animator_index_reset (AfAnimator *animator,
+                      gboolean    backward)
+{
+  g_ptr_array_set_size (animator->active_transitions, 0);
+
+  if (!backward)
+    {
+      animator->start_cursor = animator->end_cursor = 0;
+      animator->last_progress = 0.0;
+    }
+  else
+    {
+      animator->start_cursor = animator->end_cursor = animator->transitions->len;
+      animator->last_progress = 1.0;
+    }
+}
+
+static void
+animator_tracks_interpolate (AfAnimator *animator,
+                             guint       first_track,
+                             guint       last_track)
+{
+  const gdouble *from, *to, *progress;
+  gdouble *value;
+  guint k;
+
+  from = (const gdouble *) animator->tracks_from->data;
+  to = (const gdouble *) animator->tracks_to->data;
+  progress = (const gdouble *) animator->tracks_progress->data;
+  value = (gdouble *) animator->tracks_value->data;
+
+  /* plain enough for the compiler to vectorize */
+  for (k = first_track; k < last_track; k++)
+    value[k] = from[k] + (to[k] - from[k]) * progress[k];
+}
+
+static void
+animator_queue_commit (AfAnimator *animator)
+{
+  if (animator->pending_index != NOT_PENDING)
+    return;
+
+  if (G_UNLIKELY (!pending_animators))
+    {
+      pending_animators = g_ptr_array_new ();
+      frozen_targets = g_array_new (FALSE, FALSE, sizeof (AfFrozenTarget));
+      frozen_locations = g_array_new (FALSE, FALSE, sizeof (AfFrozenTarget));
+    }
+
+  animator->pending_index = pending_animators->len;
+  g_ptr_array_add (pending_animators, animator);
+}
+
+static void
+animator_freeze_targets (AfAnimator *animator)
+{
+  guint i, n_locations;
+
+  n_locations = frozen_locations->len;
+
+  for (i = 0; i < animator->commit_transitions->len; i++)
+    {
+      AfTransition *transition;
+      AfAnimatorTarget *target;
+      AfFrozenTarget frozen;
+
+      transition = g_ptr_array_index (animator->commit_transitions, i);
+
+      if (transition->target == NO_TARGET)
+        continue;
+
+      target = &g_array_index (animator->targets, AfAnimatorTarget, transition->target);
+
+      if (target->frame == commit_count)
+        continue;
+
+      target->frame = commit_count;
+
+      frozen.object = target->object;
+      frozen.changed_func = target->changed_func;
+      frozen.kind = target->kind;
+      frozen.pending_index = animator->pending_index;
+
+      /* handlers may destroy the animator before the thaw */
+      if (target->kind == TARGET_OBJECT)
+        {
+          g_object_ref (target->object);
+          g_object_freeze_notify (target->object);
+        }
+      else if (target->kind == TARGET_CHILD)
+        {
+          g_object_ref (target->object);
+          gtk_widget_freeze_child_notify (GTK_WIDGET (target->object));
+        }
+      else
+        {
+          g_array_append_val (frozen_locations, frozen);
+          continue;
+        }
+
+      g_array_append_val (frozen_targets, frozen);
+    }
+
+  if (frozen_locations->len > n_locations)
+    n_location_animators++;
+}
+
+static gint
+frozen_location_compare (gconstpointer a,
+                         gconstpointer b)
+{
+  const AfFrozenTarget *frozen_a = a;
+  const AfFrozenTarget *frozen_b = b;
+
+  if (frozen_a->object != frozen_b->object)
+    return ((gsize) frozen_a->object < (gsize) frozen_b->object) ? -1 : 1;
+
+  if (frozen_a->changed_func != frozen_b->changed_func)
+    return ((gsize) frozen_a->changed_func < (gsize) frozen_b->changed_func) ? -1 : 1;
+
+  return 0;
+}
+
+/* Calls each location change function once per data, if any
+ * animator that wrote to it is still around.
+ */
+static void
+frozen_locations_notify (void)
+{
+  AfFrozenTarget *frozen;
+  gboolean alive;
+  guint i, j;
+
+  /* pairs are distinct within an animator already,
+   * sorting brings those from several together.
+   */
+  if (n_location_animators > 1)
+    g_array_sort (frozen_locations, frozen_location_compare);
+
+  for (i = 0; i < frozen_locations->len; i = j)
+    {
+      frozen = &g_array_index (frozen_locations, AfFrozenTarget, i);
+      alive = FALSE;
+
+      for (j = i; j < frozen_locations->len; j++)
+        {
+          AfFrozenTarget *other;
+
+          other = &g_array_index (frozen_locations, AfFrozenTarget, j);
+
+          if (other->object != frozen->object ||
+              other->changed_func != frozen->changed_func)
+            break;
+
+          if (g_ptr_array_index (pending_animators, other->pending_index))
+            alive = TRUE;
+        }
+
+      if (alive)
+        (frozen->changed_func) (frozen->object);
+    }
+
+  g_array_set_size (frozen_locations, 0);
+  n_location_animators = 0;
+}
+
+/* Commit phase: writes out the values evaluated by all pending
+ * animators. Setters may notify on their own, freezing each
+ * target first folds all of the frame's writes to it into a
+ * single notification, and location change functions are
+ * called once per target after all writes.
+ */
+void
+_af_animator_run_commit (void)
+{
+  gint64 commit_start;
+  guint i, n_pending;
+
+  if (!pending_animators || pending_animators->len == 0 || committing)
+    return;
+
+  commit_start = g_get_monotonic_time ();
+  last_evaluate_time = commit_start - evaluate_start;
+  committing = TRUE;
+
+  /* handlers may evaluate further animators meanwhile,
+   * those are committed in a later round.
+   */
+  while (pending_animators->len > 0)
+    {
+      n_pending = pending_animators->len;
+      commit_count++;
+
+      for (i = 0; i < n_pending; i++)
+        {
+          AfAnimator *animator;
+
+          animator = g_ptr_array_index (pending_animators, i);
+
+          if (animator)
+            animator_freeze_targets (animator);
+        }
+
+      for (i = 0; i < n_pending; i++)
+        {
+          AfAnimator *animator;
+          guint k;
+
+          animator = g_ptr_array_index (pending_animators, i);
+
+          /* the animator may be removed by any setter */
+          for (k = 0; g_ptr_array_index (pending_animators, i) &&
+                      k < animator->commit_transitions->len; k++)
+            transition_commit (g_ptr_array_index (animator->commit_transitions, k));
+        }
+
+      for (i = frozen_targets->len; i > 0; i--)
+        {
+          AfFrozenTarget *frozen;
+
+          frozen = &g_array_index (frozen_targets, AfFrozenTarget, i - 1);
+
+          switch (frozen->kind)
+            {
+            case TARGET_OBJECT:
+              g_object_thaw_notify (frozen->object);
+              g_object_unref (frozen->object);
+              break;
+            case TARGET_CHILD:
+              gtk_widget_thaw_child_notify (GTK_WIDGET (frozen->object));
+              g_object_unref (frozen->object);
+              break;
+            }
+        }
+
+      g_array_set_size (frozen_targets, 0);
+      frozen_locations_notify ();
+
+      for (i = 0; i < n_pending; i++)
+        {
+          AfAnimator *animator;
+
+          animator = g_ptr_array_index (pending_animators, i);
+
+          if (animator)
+            animator->pending_index = NOT_PENDING;
+        }
+
+      g_ptr_array_remove_range (pending_animators, 0, n_pending);
+
+      for (i = 0; i < pending_animators->len; i++)
+        {
+          AfAnimator *animator;
+
+          animator = g_ptr_array_index (pending_animators, i);
+
+          if (animator)
+            animator->pending_index = i;
+        }
+    }
+
+  committing = FALSE;
+  last_commit_time = g_get_monotonic_time () - commit_start;
+}
+
+/* Evaluates the active transitions in [first, last), touching
+ * nothing but their own slots, so disjoint ranges can be run
+ * concurrently. Returns the number of allocations done.
+ */
+static guint
+animator_evaluate_range (AfAnimator *animator,
+                         gdouble     progress,
+                         guint       first,
+                         guint       last)
+{
+  AfTransition *transition;
+  GPtrArray *active;
+  gdouble *linear_progress, *tracks_progress;
+  AfTimelineProgressType *progress_types;
+  guint i, k, run_first, run_last;
+  guint allocations = 0;
+
+  if (first >= last)
+    return 0;
+
+  active = animator->active_transitions;
+  linear_progress = (gdouble *) animator->linear_progress->data;
+  progress_types = (AfTimelineProgressType *) animator->progress_types->data;
+  tracks_progress = (gdouble *) animator->tracks_progress->data;
+
+  for (i = first; i < last; i++)
+    {
+      gdouble transition_progress;
+
+      transition = g_ptr_array_index (active, i);
+
+      if (G_LIKELY (transition->to > transition->from))
+        {
+          transition_progress = progress - transition->from;
+          transition_progress /= (transition->to - transition->from);
+          transition_progress = CLAMP (transition_progress, 0.0, 1.0);
+        }
+      else
+        transition_progress = (progress >= transition->to) ? 1.0 : 0.0;
+
+      linear_progress[i] = transition_progress;
+      progress_types[i] = transition->type;
+    }
+
+  /* eased in place */
+  af_timeline_calculate_progress_batch (&linear_progress[first],
+                                        &progress_types[first],
+                                        &linear_progress[first],
+                                        last - first);
+
+  /* The active set is sorted by index, so the tracks of a range
+   * do not overlap other ranges. Runs of adjacent tracks are
+   * interpolated in one go, the inactive ones between are left.
+   */
+  run_first = run_last = 0;
+
+  for (i = first; i < last; i++)
+    {
+      transition = g_ptr_array_index (active, i);
+
+      if (transition->n_tracks == 0)
+        continue;
+
+      for (k = 0; k < transition->n_tracks; k++)
+        tracks_progress[transition->first_track + k] = linear_progress[i];
+
+      if (transition->first_track != run_last)
+        {
+          animator_tracks_interpolate (animator, run_first, run_last);
+          run_first = transition->first_track;
+        }
+
+      run_last = transition->first_track + transition->n_tracks;
+    }
+
+  animator_tracks_interpolate (animator, run_first, run_last);
+
+  for (i = first; i < last; i++)
+    transition_evaluate (animator, g_ptr_array_index (active, i),
+                         linear_progress[i], &allocations);
+
+  return allocations;
+}
+
+static void
+evaluate_job_run (AfEvaluateJob *job)
+{
+  guint n_active, chunk, allocations;
+
+  n_active = job->animator->active_transitions->len;
+  allocations = 0;
+
+  /* take chunks until none is left */
+  while ((chunk = __atomic_fetch_add (&job->next_chunk, 1, __ATOMIC_RELAXED)) < job->n_chunks)
+    allocations += animator_evaluate_range (job->animator, job->progress,
+                                            chunk * PARALLEL_CHUNK_SIZE,
+                                            MIN ((chunk + 1) * PARALLEL_CHUNK_SIZE, n_active));
+
+  __atomic_fetch_add (&job->allocations, allocations, __ATOMIC_RELAXED);
+}
+
+static void
+evaluate_worker_func (gpointer data,
+                      gpointer user_data)
+{
+  AfEvaluateJob *job = data;
+
+  evaluate_job_run (job);
+
+  /* the job lives in the main thread stack, leave it alone
+   * once the last worker is done.
+   */
+  if (__atomic_sub_fetch (&job->n_workers, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      g_mutex_lock (evaluate_mutex);
+      g_cond_signal (evaluate_cond);
+      g_mutex_unlock (evaluate_mutex);
+    }
+}
+
+static GThreadPool *
+evaluate_pool_get (void)
+{
+  static gboolean initialized = FALSE;
+  AfTimelineProgressType type = AF_TIMELINE_PROGRESS_LINEAR;
+  gdouble value = 0;
+  guint n_threads = 1;
+
+  if (G_LIKELY (initialized))
+    return evaluate_pool;
+
+  initialized = TRUE;
+
+  if (!g_thread_supported ())
+    return NULL;
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+  n_threads = g_get_num_processors ();
+#elif defined (_SC_NPROCESSORS_ONLN)
+  n_threads = MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+#endif
+
+  /* the main thread takes its share of the work */
+  if (n_threads < 2)
+    return NULL;
+
+  /* have the easing kernel picked before workers race for it */
+  af_timeline_calculate_progress_batch (&value, &type, &value, 1);
+
+  n_evaluate_workers = n_threads - 1;
+
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  g_mutex_init (&evaluate_mutex_storage);
+  g_cond_init (&evaluate_cond_storage);
+  evaluate_mutex = &evaluate_mutex_storage;
+  evaluate_cond = &evaluate_cond_storage;
+#else
+  evaluate_mutex = g_mutex_new ();
+  evaluate_cond = g_cond_new ();
+#endif
+
+  evaluate_pool = g_thread_pool_new (evaluate_worker_func, NULL,
+                                     n_evaluate_workers, TRUE, NULL);
+
+  return evaluate_pool;
+}
+
+/* Splits evaluation in chunks, taken in turns by the main thread
+ * and the pool workers, so faster threads get to do more. Each
+ * chunk writes to its own slots, the result is the same as when
+ * evaluating serially.
+ */
+static void
+animator_evaluate_parallel (AfAnimator *animator,
+                            gdouble     progress)
+{
+  AfEvaluateJob job;
+  guint i, n_workers;
+
+  job.animator = animator;
+  job.progress = progress;
+  job.n_chunks = (animator->active_transitions->len + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+  job.next_chunk = 0;
+  job.allocations = 0;
+
+  n_workers = MIN (n_evaluate_workers, job.n_chunks - 1);
+  job.n_workers = n_workers;
+
+  for (i = 0; i < n_workers; i++)
+    g_thread_pool_push (evaluate_pool, &job, NULL);
+
+  evaluate_job_run (&job);
+
+  g_mutex_lock (evaluate_mutex);
+
+  while (__atomic_load_n (&job.n_workers, __ATOMIC_ACQUIRE) > 0)
+    g_cond_wait (evaluate_cond, evaluate_mutex);
+
+  g_mutex_unlock (evaluate_mutex);
+
+  animator->frame_allocations += job.allocations;
+}
+
+/* Once springs are at rest, and nothing else is left to play,
+ * the timeline is sent to its end to finish on the next frame.
+ */
+static void
+animator_check_settled (AfAnimator *animator)
+{
+  AfTransition *transition;
+  guint i;
+
+  if (animator->settled ||
+      animator->start_cursor < animator->transitions->len)
+    return;
+
+  for (i = 0; i < animator->active_transitions->len; i++)
+    {
+      transition = g_ptr_array_index (animator->active_transitions, i);
+
+      if (!transition->spring || !transition->spring->at_rest)
+        return;
+    }
+
+  animator->settled = TRUE;
+  af_timeline_set_progress (animator->timeline, 1.0);
+}
+
+static void
+animator_frame_cb (AfTimeline *timeline,
+                   gdouble     progress,
+                   gpointer    user_data)
+{
+  AfAnimator *animator;
+  AfTransition *transition;
+  GPtrArray *active;
+  gboolean backward;
+  guint i, j, n_transitions;
+
+  animator = (AfAnimator *) user_data;
+  backward = (af_timeline_get_direction (timeline) == AF_TIMELINE_DIRECTION_BACKWARD);
+  animator->frame_allocations = 0;
+
+  /* the first animator of the frame starts the evaluate phase */
+  if (!pending_animators || pending_animators->len == 0)
+    evaluate_start = g_get_monotonic_time ();
+
+  if (G_UNLIKELY (animator->index_dirty))
+    animator->frame_allocations += animator_index_rebuild (animator, backward);
+
+  /* Looping, or seeking against the playback
+   * direction, starts the sweep all over.
+   */
+  if ((!backward && progress < animator->last_progress) ||
+      (backward && progress > animator->last_progress))
+    animator_index_reset (animator, backward);
+
+  n_transitions = animator->transitions->len;
+
+  if (!backward)
+    {
+      while (animator->start_cursor < n_transitions)
+        {
+          transition = g_ptr_array_index (animator->transitions, animator->start_cursor);
+
+          if (transition->from >= progress)
+            break;
+
+          animator_activate_transition (animator, transition);
+          animator->start_cursor++;
+        }
+
+      while (animator->end_cursor < n_transitions &&
+             ((AfTransition *) g_ptr_array_index (animator->transitions_by_end,
+                                                  animator->end_cursor))->to <= progress)
+        animator->end_cursor++;
+    }
+  else
+    {
+      while (animator->end_cursor > 0)
+        {
+          transition = g_ptr_array_index (animator->transitions_by_end, animator->end_cursor - 1);
+
+          if (transition->to <= progress)
+            break;
+
+          animator_activate_transition (animator, transition);
+          animator->end_cursor--;
+        }
+
+      while (animator->start_cursor > 0 &&
+             ((AfTransition *) g_ptr_array_index (animator->transitions,
+                                                  animator->start_cursor - 1))->from >= progress)
+        animator->start_cursor--;
+    }
+
+  active = animator->active_transitions;
+  g_array_set_size (animator->linear_progress, active->len);
+  g_array_set_size (animator->progress_types, active->len);
+
+  /* initial values are read from the objects, so
+   * this needs to happen here, before evaluating.
+   */
+  for (i = 0; i < active->len; i++)
+    {
+      transition = g_ptr_array_index (active, i);
+
+      if (G_UNLIKELY (!transition->has_from))
+        transition_capture_from (animator, transition);
+    }
+
+  animator->frame_progress = progress;
+
+  if (animator->n_springs > 0)
+    animator->spring_time = progress * af_timeline_get_duration (timeline) * 1000;
+
+  if (animator->parallel &&
+      active->len >= PARALLEL_MIN_TRANSITIONS &&
+      evaluate_pool_get ())
+    animator_evaluate_parallel (animator, progress);
+  else
+    animator->frame_allocations +=
+      animator_evaluate_range (animator, progress, 0, active->len);
+
+  g_ptr_array_set_size (animator->commit_transitions, 0);
+
+  for (i = 0, j = 0; i < active->len; i++)
+    {
+      transition = g_ptr_array_index (active, i);
+      g_ptr_array_add (animator->commit_transitions, transition);
+
+      /* leaves the active set once played through */
+      if ((!backward && progress >= transition->to) ||
+          (backward && progress <= transition->from))
+        continue;
+
+      active->pdata[j++] = transition;
+    }
+
+  g_ptr_array_set_size (active, j);
+  animator->last_progress = progress;
+
+  if (animator->n_springs > 0 && !backward && progress < 1.0)
+    animator_check_settled (animator);
+
+  animator_queue_commit (animator);
+}
+
+static gboolean
+transition_add_property (AfTransition            *transition,
+                         GParamSpec              *pspec,
+                         GValue                  *to,
+			 AfTypeTransformationFunc func)
+{
+  AfPropertyRange property_range = { 0, };
+
+  if (G_VALUE_TYPE (to) != pspec->value_type)
+    {
+      g_warning ("Target value type (%s) do not match property type (%s)",
+                 G_VALUE_TYPE_NAME (to),
+                 g_type_name (pspec->value_type));
+      return FALSE;
+    }
+
+  if (!(pspec->flags & G_PARAM_WRITABLE) ||
+      (pspec->flags & G_PARAM_CONSTRUCT_ONLY))
+    {
+      g_warning ("Property '%s' is not writable", pspec->name);
+      return FALSE;
+    }
+
+  property_range.pspec = g_param_spec_ref (pspec);
+  property_range.track = -1;
+  g_value_init (&property_range.value, pspec->value_type);
+  property_range_resolve (transition, &property_range);
+
+  g_value_init (&property_range.to, pspec->value_type);
+  g_value_copy (to, &property_range.to);
+
+  property_range.func = func;
+  property_range_resolve_func (&property_range);
+
+  g_array_append_val (transition->properties, property_range);
+
+  return TRUE;
+}
+
+static void
+transition_add_properties (AfTransition *transition,
+                           va_list       args)
+{
+  const gchar *property_name;
+  GObject *object, *child;
+
+  property_name = va_arg (args, const gchar *);
+  object = transition->object;
+  child = transition->child;
+
+  while (property_name)
+    {
+      GParamSpec *pspec;
+      GValue to = { 0, };
+      GValue func = { 0, };
+      gchar *error = NULL;
+
+      if (!child)
+        pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                              property_name);
+      else
+        pspec = gtk_container_class_find_child_property (G_OBJECT_GET_CLASS (object),
+                                                         property_name);
+
+      if (G_UNLIKELY (!pspec))
+        {
+          g_warning ("Property '%s' does not exist on object of class '%s'",
+                     property_name, G_OBJECT_TYPE_NAME (object));
+          break;
+        }
+
+      g_value_init (&to, pspec->value_type);
+      G_VALUE_COLLECT (&to, args, 0, &error);
+
+      if (error)
+        {
+          g_warning (error);
+          g_free (error);
+          break;
+        }
+
+      g_value_init (&func, G_TYPE_POINTER);
+      G_VALUE_COLLECT (&func, args, 0, &error);
+
+      if (error)
+        {
+          g_warning (error);
+          g_free (error);
+          break;
+        }
+
+      transition_add_property (transition, pspec, &to, 
+		               (AfTypeTransformationFunc)g_value_get_pointer (&func));
+
+      g_value_unset (&to);
+      g_value_unset (&func);
+
+      property_name = va_arg (args, const gchar *);
+    }
+}
+
+static void
+transition_add_locations (AfTransition *transition,
+                          va_list       args)
+{
+  GType type;
+
+  type = va_arg (args, GType);
+
+  while (type != G_TYPE_INVALID)
+    {
+      AfLocationRange location_range = { 0, };
+      GValue to = { 0, };
+      gchar *error = NULL;
+      gpointer location;
+
+      location = va_arg (args, gpointer);
+
+      if (G_UNLIKELY (!value_type_is_numeric (type)))
+        {
+          g_warning ("Locations of type '%s' can not be animated",
+                     g_type_name (type));
+          break;
+        }
+
+      if (G_UNLIKELY (!location))
+        {
+          g_warning ("NULL location given for a transition");
+          break;
+        }
+
+      g_value_init (&to, type);
+      G_VALUE_COLLECT (&to, args, 0, &error);
+
+      if (error)
+        {
+          g_warning (error);
+          g_free (error);
+          break;
+        }
+
+      location_range.location = location;
+      location_range.type = type;
+      location_range.to = value_get_numeric (&to);
+      location_range.track = -1;
+      g_array_append_val (transition->locations, location_range);
+
+      g_value_unset (&to);
+
+      type = va_arg (args, GType);
+    }
+}
+
+/* Like af_animator_register_type_transformation(), but trans_func
+ * writes to a buffer owned by the animator, so no boxed copies are
+ * done on frames. Takes precedence over GValue based functions.
+ */
+void
+af_animator_register_type_transformation_in_place (GType                           type,
+                                                   AfTypeInPlaceTransformationFunc trans_func)
+{
+  g_return_if_fail (G_TYPE_IS_BOXED (type));
+
+  if (!in_place_types)
+    in_place_types = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  if (!trans_func)
+    g_hash_table_remove (in_place_types, GSIZE_TO_POINTER (type));
+  else
+    g_hash_table_insert (in_place_types,
+                         GSIZE_TO_POINTER (type),
+                         trans_func);
+
+  registry_generation++;
+}
+
+void
+af_animator_register_type_transformation (GType                    type,
+                                          AfTypeTransformationFunc trans_func)
+{
+  if (!transformable_types)
+    transformable_types = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  if (!trans_func)
+    g_hash_table_remove (transformable_types, GSIZE_TO_POINTER (type));
+  else
+    g_hash_table_insert (transformable_types,
+                         GSIZE_TO_POINTER (type),
+                         trans_func);
+
+  registry_generation++;
+
+  /* may take over numeric types, or give them back */
+  if (animator_slots)
+    {
+      guint i;
+
+      for (i = 0; i < animator_slots->len; i++)
+        {
+          AfAnimator *animator;
+
+          animator = g_array_index (animator_slots, AfAnimatorSlot, i).animator;
+
+          if (animator)
+            animator->index_dirty = TRUE;
+        }
+    }
+}
+
+guint
+af_animator_add (void)
+{
+  AfAnimator *animator;
+  guint id;
+
+  animator = af_animator_new ();
+  id = animator_slot_acquire (animator);
+
+  if (G_UNLIKELY (id == 0))
+    af_animator_free (animator);
+
+  return id;
+}
+
+gboolean
+af_animator_set_user_data (guint          anim_id,
+		           gpointer       user_data,
+		           GDestroyNotify value_destroy_func)
+{
+  AfAnimator *animator;
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  if (animator->value_destroy_func)
+    (animator->value_destroy_func) (animator->user_data);
+
+  animator->user_data = user_data;
+  animator->value_destroy_func = value_destroy_func;
+
+  return TRUE;
+}
+
+gboolean
+af_animator_set_finished_notify (guint anim_id,
+		                 AfFinishedAnimationNotify finished_notify)
+{
+  AfAnimator *animator;
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  animator->finished_notify = finished_notify;
+
+  return TRUE;
+}
+
+/* Debugging aid: allocations done by the animator itself during
+ * its last frame. Once every transition played its first frame
+ * this stays at 0, unless GValue based transformation functions
+ * are used on boxed or string properties. It is not a count of
+ * all allocations of a frame: property setters, and GObject's
+ * notify queues allocated by freezing and notifying targets on
+ * every commit, are not accounted.
+ */
+guint
+af_animator_get_frame_allocations (guint anim_id)
+{
+  AfAnimator *animator;
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, 0);
+
+  return animator->frame_allocations;
+}
+
+/* Wall time spent in each phase of the last frame, in
+ * microseconds: from the first animator evaluation to the
+ * commit, which includes other timeline handlers, and the
+ * commit of all animators itself.
+ */
+void
+af_animator_get_frame_timings (gint64 *evaluate_time,
+                               gint64 *commit_time)
+{
+  if (evaluate_time)
+    *evaluate_time = last_evaluate_time;
+
+  if (commit_time)
+    *commit_time = last_commit_time;
+}
+
+/* Opts the animator in to evaluating large sets of transitions
+ * on a pool of worker threads. Initial values are still read,
+ * and properties are still set, on the main thread, but all
+ * transformation functions involved need to be thread-safe.
+ */
+gboolean
+af_animator_set_parallel (guint    anim_id,
+                          gboolean parallel)
+{
+  AfAnimator *animator;
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  animator->parallel = (parallel != FALSE);
+
+  return TRUE;
+}
+
+gboolean
+af_animator_set_clock (guint    anim_id,
+                       AfClock *clock)
+{
+  AfAnimator *animator;
+
+  g_return_val_if_fail (AF_IS_CLOCK (clock), FALSE);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  g_object_ref (clock);
+
+  if (animator->clock)
+    g_object_unref (animator->clock);
+
+  animator->clock = clock;
+
+  if (animator->timeline)
+    af_timeline_set_clock (animator->timeline, clock);
+
+  return TRUE;
+}
+
+AfTransition*
+af_animator_add_transition_valist (guint                   anim_id,
+                                   gdouble                 from,
+                                   gdouble                 to,
+                                   AfTimelineProgressType  type,
+                                   GObject                *object,
+                                   va_list                 args)
+{
+  AfAnimator *animator;
+  AfTransition *transition;
+
+  g_return_val_if_fail (anim_id != 0, FALSE);
+  g_return_val_if_fail (from >= 0.0 && from <= 1.0, FALSE);
+  g_return_val_if_fail (to >= 0.0 && to <= 1.0, FALSE);
+  g_return_val_if_fail (from <= to, FALSE);
+  g_return_val_if_fail (G_IS_OBJECT (object), FALSE);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  transition = af_transition_new (object, NULL, from, to, type);
+
+  transition_add_properties (transition, args);
+
+  animator_add_transition (animator, transition);
+
+  return transition;
+}
+
+AfTransition*
+af_animator_add_transition (guint                   anim_id,
+                            gdouble                 from,
+                            gdouble                 to,
+                            AfTimelineProgressType  type,
+                            GObject                *object,
+                            ...)
+{
+  AfTransition *result;
+  va_list args;
+
+  va_start (args, object);
+  result = af_animator_add_transition_valist (anim_id,
+                                              from, to,
+                                              type,
+                                              object, args);
+  va_end (args);
+
+  va_start (args, object);
+  return result;
+}
+
+AfTransition*
+af_animator_add_child_transition_valist (guint                    anim_id,
+                                         gdouble                  from,
+                                         gdouble                  to,
+                                         AfTimelineProgressType   type,
+                                         GtkContainer            *container,
+                                         GtkWidget               *child,
+                                         va_list                  args)
+{
+  AfAnimator *animator;
+  AfTransition *transition;
+
+  g_return_val_if_fail (anim_id != 0, FALSE);
+  g_return_val_if_fail (from >= 0.0 && from <= 1.0, FALSE);
+  g_return_val_if_fail (to >= 0.0 && to <= 1.0, FALSE);
+  g_return_val_if_fail (from <= to, FALSE);
+  g_return_val_if_fail (GTK_IS_CONTAINER (container), FALSE);
+  g_return_val_if_fail (GTK_IS_WIDGET (child), FALSE);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  transition = af_transition_new (G_OBJECT (container),
+                                  G_OBJECT (child),
+                                  from, to,
+                                  type);
+
+  transition_add_properties (transition, args);
+
+  animator_add_transition (animator, transition);
+
+  return transition;
+}
+
+AfTransition*
+af_animator_add_child_transition (guint                   anim_id,
+                                  gdouble                 from,
+                                  gdouble                 to,
+                                  AfTimelineProgressType  type,
+                                  GtkContainer           *container,
+                                  GtkWidget              *child,
+                                  ...)
+{
+  AfTransition *result;
+  va_list args;
+
+  va_start (args, child);
+  result = af_animator_add_child_transition_valist (anim_id,
+                                                    from, to,
+                                                    type,
+                                                    container, child, args);
+  va_end (args);
+
+  return result;
+}
+
+/* Animates plain memory: arguments are triplets of a numeric GType,
+ * a pointer to a variable or struct field of that type, and the
+ * target value, ended by G_TYPE_INVALID. Values are written straight
+ * to memory, then @changed_func is called once per frame. Neither
+ * GValues nor property setters are involved, and transformation
+ * functions do not apply. @user_data is passed to @changed_func.
+ */
+AfTransition*
+af_animator_add_location_transition_valist (guint                   anim_id,
+                                            gdouble                 from,
+                                            gdouble                 to,
+                                            AfTimelineProgressType  type,
+                                            AfLocationChangedFunc   changed_func,
+                                            gpointer                user_data,
+                                            va_list                 args)
+{
+  AfAnimator *animator;
+  AfTransition *transition;
+
+  g_return_val_if_fail (anim_id != 0, NULL);
+  g_return_val_if_fail (from >= 0.0 && from <= 1.0, NULL);
+  g_return_val_if_fail (to >= 0.0 && to <= 1.0, NULL);
+  g_return_val_if_fail (from <= to, NULL);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, NULL);
+
+  transition = af_transition_new (NULL, NULL, from, to, type);
+  transition->locations = g_array_new (FALSE, FALSE, sizeof (AfLocationRange));
+  transition->changed_func = changed_func;
+  transition->changed_data = user_data;
+
+  transition_add_locations (transition, args);
+
+  animator_add_transition (animator, transition);
+
+  return transition;
+}
+
+AfTransition*
+af_animator_add_location_transition (guint                   anim_id,
+                                     gdouble                 from,
+                                     gdouble                 to,
+                                     AfTimelineProgressType  type,
+                                     AfLocationChangedFunc   changed_func,
+                                     gpointer                user_data,
+                                     ...)
+{
+  AfTransition *result;
+  va_list args;
+
+  va_start (args, user_data);
+  result = af_animator_add_location_transition_valist (anim_id,
+                                                       from, to,
+                                                       type,
+                                                       changed_func,
+                                                       user_data,
+                                                       args);
+  va_end (args);
+
+  return result;
+}
+
+/* Animates a numeric property through a series of keyframes,
+ * all held in a single transition, from the first keyframe to
+ * the last. Between keyframes the value eases with the type of
+ * the keyframe it goes to.
+ */
+AfTransition*
+af_animator_add_keyframe_transition (guint             anim_id,
+                                     GObject          *object,
+                                     const gchar      *property_name,
+                                     const AfKeyframe *keyframes,
+                                     guint             n_keyframes)
+{
+  AfAnimator *animator;
+  AfTransition *transition;
+  AfPropertyRange *property_range;
+  GParamSpec *pspec;
+  GValue to = { 0, };
+  guint i;
+
+  g_return_val_if_fail (anim_id != 0, NULL);
+  g_return_val_if_fail (G_IS_OBJECT (object), NULL);
+  g_return_val_if_fail (property_name != NULL, NULL);
+  g_return_val_if_fail (keyframes != NULL, NULL);
+  g_return_val_if_fail (n_keyframes >= 2, NULL);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, NULL);
+
+  for (i = 0; i < n_keyframes; i++)
+    {
+      if (keyframes[i].progress < 0.0 || keyframes[i].progress > 1.0 ||
+          (i > 0 && keyframes[i].progress < keyframes[i - 1].progress))
+        {
+          g_warning ("Keyframes must be sorted by progress, between 0 and 1");
+          return NULL;
+        }
+    }
+
+  if (keyframes[n_keyframes - 1].progress <= keyframes[0].progress)
+    {
+      g_warning ("Keyframes must span a progress range");
+      return NULL;
+    }
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                        property_name);
+
+  if (G_UNLIKELY (!pspec))
+    {
+      g_warning ("Property '%s' does not exist on object of class '%s'",
+                 property_name, G_OBJECT_TYPE_NAME (object));
+      return NULL;
+    }
+
+  if (!value_type_is_numeric (pspec->value_type))
+    {
+      g_warning ("Properties of type '%s' can not be animated through keyframes",
+                 g_type_name (pspec->value_type));
+      return NULL;
+    }
+
+  transition = af_transition_new (object, NULL,
+                                  keyframes[0].progress,
+                                  keyframes[n_keyframes - 1].progress,
+                                  AF_TIMELINE_PROGRESS_LINEAR);
+  transition->keyframes = g_array_sized_new (FALSE, FALSE, sizeof (AfKeyframe),
+                                             n_keyframes);
+  g_array_append_vals (transition->keyframes, keyframes, n_keyframes);
+
+  g_value_init (&to, pspec->value_type);
+  value_set_numeric (&to, keyframes[n_keyframes - 1].value);
+
+  if (!transition_add_property (transition, pspec, &to, NULL))
+    {
+      g_value_unset (&to);
+      af_transition_free (transition);
+      return NULL;
+    }
+
+  g_value_unset (&to);
+
+  /* all values are given, nothing to read from the object */
+  property_range = &g_array_index (transition->properties, AfPropertyRange, 0);
+  g_value_init (&property_range->from, pspec->value_type);
+  value_set_numeric (&property_range->from, keyframes[0].value);
+
+  animator_add_transition (animator, transition);
+
+  return transition;
+}
+
+/* Collects property name and target value pairs for a spring,
+ * only numeric properties can be driven by one.
+ */
+static gboolean
+transition_add_spring_properties (AfTransition *transition,
+                                  va_list       args)
+{
+  const gchar *property_name;
+  GObject *object;
+
+  property_name = va_arg (args, const gchar *);
+  object = transition->object;
+
+  while (property_name)
+    {
+      AfSpringState state = { 0, };
+      GParamSpec *pspec;
+      GValue to = { 0, };
+      gchar *error = NULL;
+
+      pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                            property_name);
 
-      transition_add_property (transition, pspec, &to, 
-		               (AfTypeTransformationFunc)g_value_get_pointer (&func));
+      if (G_UNLIKELY (!pspec))
+        {
+          g_warning ("Property '%s' does not exist on object of class '%s'",
+                     property_name, G_OBJECT_TYPE_NAME (object));
+          return FALSE;
+        }
+
+      if (!value_type_is_numeric (pspec->value_type))
+        {
+          g_warning ("Properties of type '%s' can not be driven by a spring",
+                     g_type_name (pspec->value_type));
+          return FALSE;
+        }
+
+      g_value_init (&to, pspec->value_type);
+      G_VALUE_COLLECT (&to, args, 0, &error);
+
+      if (error)
+        {
+          g_warning (error);
+          g_free (error);
+          return FALSE;
+        }
+
+      if (!transition_add_property (transition, pspec, &to, NULL))
+        {
+          g_value_unset (&to);
+          return FALSE;
+        }
 
+      state.target = value_get_numeric (&to);
+      g_array_append_val (transition->spring->states, state);
       g_value_unset (&to);
-      g_value_unset (&func);
 
       property_name = va_arg (args, const gchar *);
     }
+
+  return TRUE;
 }
 
-void
-af_animator_register_type_transformation (GType                    type,
-                                          AfTypeTransformationFunc trans_func)
+/* Drives the given properties towards their target values with a
+ * damped spring, over the whole animator progress. Springs take
+ * as long as the physics say, up to the animator duration, and
+ * the animator finishes early once all of them are at rest.
+ */
+AfTransition*
+af_animator_add_spring_transition_valist (guint    anim_id,
+                                          gdouble  stiffness,
+                                          gdouble  damping,
+                                          gdouble  mass,
+                                          GObject *object,
+                                          va_list  args)
 {
-  if (!transformable_types)
-    transformable_types = g_hash_table_new (g_direct_hash, g_direct_equal);
+  AfAnimator *animator;
+  AfTransition *transition;
 
-  if (!trans_func)
-    g_hash_table_remove (transformable_types, GSIZE_TO_POINTER (type));
-  else
-    g_hash_table_insert (transformable_types,
-                         GSIZE_TO_POINTER (type),
-                         trans_func);
+  g_return_val_if_fail (anim_id != 0, NULL);
+  g_return_val_if_fail (stiffness > 0.0, NULL);
+  g_return_val_if_fail (damping >= 0.0, NULL);
+  g_return_val_if_fail (mass > 0.0, NULL);
+  g_return_val_if_fail (G_IS_OBJECT (object), NULL);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, NULL);
+
+  transition = af_transition_new (object, NULL, 0.0, 1.0,
+                                  AF_TIMELINE_PROGRESS_LINEAR);
+  transition->spring = g_slice_new0 (AfSpring);
+  transition->spring->stiffness = stiffness;
+  transition->spring->damping = damping;
+  transition->spring->mass = mass;
+  transition->spring->states = g_array_new (FALSE, FALSE, sizeof (AfSpringState));
+
+  if (!transition_add_spring_properties (transition, args))
+    {
+      af_transition_free (transition);
+      return NULL;
+    }
+
+  animator_add_transition (animator, transition);
+  animator->n_springs++;
+
+  return transition;
 }
 
-guint
-af_animator_add (void)
+AfTransition*
+af_animator_add_spring_transition (guint    anim_id,
+                                   gdouble  stiffness,
+                                   gdouble  damping,
+                                   gdouble  mass,
+                                   GObject *object,
+                                   ...)
+{
+  AfTransition *result;
+  va_list args;
+
+  va_start (args, object);
+  result = af_animator_add_spring_transition_valist (anim_id,
+                                                     stiffness, damping, mass,
+                                                     object, args);
+  va_end (args);
+
+  return result;
+}
+
+/* Moves the target of a spring property, keeping its current
+ * position and velocity, and wakes the spring if it was at rest.
+ */
+gboolean
+af_animator_set_spring_target (guint         anim_id,
+                               AfTransition *transition,
+                               const gchar  *property_name,
+                               gdouble       target)
 {
   AfAnimator *animator;
-  guint id;
+  AfSpringState *state;
+  guint i;
+
+  g_return_val_if_fail (transition != NULL, FALSE);
+  g_return_val_if_fail (transition->spring != NULL, FALSE);
+  g_return_val_if_fail (property_name != NULL, FALSE);
+
+  animator = animator_lookup (anim_id);
+
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  for (i = 0; i < transition->properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+
+      property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+
+      if (strcmp (property_range->pspec->name, property_name) == 0)
+        break;
+    }
+
+  if (i == transition->properties->len)
+    {
+      g_warning ("Property '%s' is not driven by this spring", property_name);
+      return FALSE;
+    }
+
+  state = &g_array_index (transition->spring->states, AfSpringState, i);
+
+  if (!transition->spring->started)
+    {
+      state->target = target;
+      return TRUE;
+    }
+
+  spring_state_aim (state, target);
+
+  /* the time spent at rest is not integrated */
+  if (transition->spring->at_rest)
+    {
+      AfSpringState *states;
+
+      states = (AfSpringState *) transition->spring->states->data;
+
+      for (i = 0; i < transition->spring->states->len; i++)
+        states[i].previous = states[i].position;
+
+      transition->spring->time = animator->spring_time;
+      transition->spring->at_rest = FALSE;
+    }
+
+  /* bring back the timeline if it was sent to finish */
+  if (animator->settled)
+    {
+      animator->settled = FALSE;
+      af_timeline_set_progress (animator->timeline, animator->last_progress);
+    }
+
+  return TRUE;
+}
+
+typedef struct
+{
+  const gchar *property_name;
+  GValue value;
+} AfRetarget;
+
+static AfRetarget *
+retargets_find (GArray      *retargets,
+                const gchar *property_name)
+{
+  guint i;
+
+  for (i = 0; i < retargets->len; i++)
+    {
+      AfRetarget *retarget;
+
+      retarget = &g_array_index (retargets, AfRetarget, i);
+
+      if (strcmp (retarget->property_name, property_name) == 0)
+        return retarget;
+    }
+
+  return NULL;
+}
+
+static void retargets_free (GArray *retargets);
+
+/* The first property named @property_name in the animator transitions */
+static GParamSpec *
+animator_find_pspec (AfAnimator   *animator,
+                     AfTransition *only_transition,
+                     const gchar  *property_name)
+{
+  guint i, j;
+
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+
+      transition = g_ptr_array_index (animator->transitions, i);
+
+      if (only_transition && transition != only_transition)
+        continue;
+
+      for (j = 0; j < transition->properties->len; j++)
+        {
+          AfPropertyRange *property_range;
+
+          property_range = &g_array_index (transition->properties, AfPropertyRange, j);
+
+          if (strcmp (property_range->pspec->name, property_name) == 0)
+            return property_range->pspec;
+        }
+    }
+
+  return NULL;
+}
+
+/* Collects property name and value pairs, each value typed after
+ * the first matching property in the animator transitions. Returns
+ * %NULL if any of them can not be collected.
+ */
+static GArray *
+retargets_collect (AfAnimator   *animator,
+                   AfTransition *only_transition,
+                   va_list       args)
+{
+  GArray *retargets;
+  const gchar *property_name;
+
+  retargets = g_array_new (FALSE, TRUE, sizeof (AfRetarget));
+  property_name = va_arg (args, const gchar *);
+
+  while (property_name)
+    {
+      AfRetarget retarget = { 0, };
+      GParamSpec *pspec;
+      gchar *error = NULL;
+
+      pspec = animator_find_pspec (animator, only_transition, property_name);
+
+      if (!pspec)
+        {
+          g_warning ("Property '%s' is not animated by this animator", property_name);
+          retargets_free (retargets);
+          return NULL;
+        }
+
+      retarget.property_name = property_name;
+      g_value_init (&retarget.value, pspec->value_type);
+      G_VALUE_COLLECT (&retarget.value, args, 0, &error);
+
+      if (error)
+        {
+          g_warning (error);
+          g_free (error);
+
+          /* the value may be half collected, leak it as GObject does */
+          retargets_free (retargets);
+          return NULL;
+        }
+
+      g_array_append_val (retargets, retarget);
+      property_name = va_arg (args, const gchar *);
+    }
+
+  return retargets;
+}
+
+static void
+retargets_free (GArray *retargets)
+{
+  guint i;
+
+  for (i = 0; i < retargets->len; i++)
+    g_value_unset (&g_array_index (retargets, AfRetarget, i).value);
+
+  g_array_free (retargets, TRUE);
+}
+
+/* Restarts an active or finished transition from its value at
+ * @progress, over [0, @to] of the rebased playback. Numeric
+ * properties keep their velocity through the velocity term.
+ */
+static void
+transition_rebase (AfTransition *transition,
+                   GArray       *retargets,
+                   gdouble       progress,
+                   gdouble       to,
+                   gdouble       time_scale)
+{
+  gdouble s, ease, ease_slope, start_slope;
+  gboolean moving;
+  guint i;
+
+  moving = (transition->to > progress && transition->to > transition->from);
+
+  if (transition->to > transition->from)
+    s = CLAMP ((progress - transition->from) / (transition->to - transition->from), 0.0, 1.0);
+  else
+    s = 1.0;
+
+  ease = _af_easing_calculate (s, transition->type);
+  ease_slope = easing_slope (transition->type, s);
+  start_slope = easing_slope (transition->type, 0.0);
+
+  for (i = 0; i < transition->properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+      AfRetarget *retarget;
+      GType type;
+
+      property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+      retarget = retargets_find (retargets, property_range->pspec->name);
+      type = property_range->pspec->value_type;
+
+      if (retarget && G_VALUE_TYPE (&retarget->value) != type)
+        retarget = NULL;
+
+      if (value_type_is_numeric (type) && !property_range->trans_func)
+        {
+          gdouble from, current, target, slope, offset;
+
+          from = value_get_numeric (&property_range->from);
+          target = value_get_numeric (&property_range->to);
+          offset = (transition->retargeted) ? property_range->velocity_offset : 0.0;
+
+          current = from + (target - from) * ease + offset * velocity_basis (s);
+
+          /* slope over the transition span, and over the new one */
+          slope = 0.0;
+
+          if (moving)
+            slope = ((target - from) * ease_slope +
+                     offset * velocity_basis_slope (s)) * time_scale;
+
+          if (retarget)
+            target = value_get_numeric (&retarget->value);
+
+          value_set_numeric (&property_range->from, current);
+          value_set_numeric (&property_range->to, target);
+          property_range->velocity_offset = slope - (target - current) * start_slope;
+        }
+      else
+        {
+          /* the last value set is the current one */
+          g_value_copy (&property_range->value, &property_range->from);
+
+          if (retarget)
+            g_value_copy (&retarget->value, &property_range->to);
+
+          property_range->velocity_offset = 0.0;
+        }
+    }
+
+  transition->from = 0.0;
+  transition->to = to;
+  transition->retargeted = TRUE;
+}
+
+/* Whether @transition animates any of the retargeted properties */
+static gboolean
+transition_is_retargeted (AfTransition *transition,
+                          GArray       *retargets)
+{
+  guint i;
+
+  for (i = 0; i < transition->properties->len; i++)
+    {
+      AfPropertyRange *property_range;
+
+      property_range = &g_array_index (transition->properties, AfPropertyRange, i);
+
+      if (retargets_find (retargets, property_range->pspec->name))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Checks everything a retarget may fail on before the animator is
+ * touched, so failed retargets leave it as it was.
+ */
+static gboolean
+animator_retarget_check (AfAnimator   *animator,
+                         AfTransition *only_transition,
+                         GArray       *retargets)
+{
+  guint i;
+
+  if (animator->timeline &&
+      af_timeline_get_direction (animator->timeline) == AF_TIMELINE_DIRECTION_BACKWARD)
+    {
+      g_warning ("Animators playing backwards can not be retargeted");
+      return FALSE;
+    }
+
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+
+      transition = g_ptr_array_index (animator->transitions, i);
+
+      if (transition->spring)
+        {
+          g_warning ("Animators with springs are retargeted "
+                     "through af_animator_set_spring_target()");
+          return FALSE;
+        }
+
+      if (transition->keyframes &&
+          (!only_transition || transition == only_transition) &&
+          transition_is_retargeted (transition, retargets))
+        {
+          g_warning ("Keyframe transitions can not be retargeted");
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+animator_retarget (AfAnimator   *animator,
+                   AfTransition *only_transition,
+                   guint         duration,
+                   GArray       *retargets)
+{
+  gdouble progress, remaining;
+  guint i, j, old_duration;
+
+  if (!animator_retarget_check (animator, only_transition, retargets))
+    return FALSE;
+
+  /* not started, only the targets change */
+  if (!animator->timeline)
+    {
+      for (i = 0; i < animator->transitions->len; i++)
+        {
+          AfTransition *transition;
+
+          transition = g_ptr_array_index (animator->transitions, i);
+
+          if (only_transition && transition != only_transition)
+            continue;
+
+          for (j = 0; j < transition->properties->len; j++)
+            {
+              AfPropertyRange *property_range;
+              AfRetarget *retarget;
+
+              property_range = &g_array_index (transition->properties, AfPropertyRange, j);
+              retarget = retargets_find (retargets, property_range->pspec->name);
+
+              if (retarget &&
+                  G_VALUE_TYPE (&retarget->value) == property_range->pspec->value_type)
+                g_value_copy (&retarget->value, &property_range->to);
+            }
+        }
+
+      animator->index_dirty = TRUE;
+
+      return TRUE;
+    }
+
+  /* Values are on screen as of the last frame, the rest of the
+   * playback from there is mapped onto a new [0, 1] run.
+   */
+  progress = MIN (animator->last_progress, 1.0 - 1e-9);
+  remaining = 1.0 - progress;
+  old_duration = af_timeline_get_duration (animator->timeline);
 
-  animator = af_animator_new ();
-  id = ++id_count;
+  if (duration == 0)
+    duration = MAX ((guint) (old_duration * remaining + 0.5), 1);
 
-  if (G_UNLIKELY (!animators))
-    animators = g_hash_table_new_full (g_direct_hash,
-                                       g_direct_equal,
-                                       NULL,
-                                       (GDestroyNotify) af_animator_free);
+  for (i = 0; i < animator->transitions->len; i++)
+    {
+      AfTransition *transition;
+      gboolean retargeted;
 
-  g_hash_table_insert (animators,
-                       GUINT_TO_POINTER (id),
-                       animator);
-  return id;
-}
+      transition = g_ptr_array_index (animator->transitions, i);
+      retargeted = ((!only_transition || transition == only_transition) &&
+                    transition_is_retargeted (transition, retargets));
 
-gboolean
-af_animator_set_user_data (guint          anim_id,
-		           gpointer       user_data,
-		           GDestroyNotify value_destroy_func)
-{
-  AfAnimator *animator;
+      if (retargeted && transition->has_from && transition->from < progress)
+        {
+          gdouble to, time_scale;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
+          to = (transition->to > progress) ? (transition->to - progress) / remaining : 1.0;
 
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (anim_id));
+          /* span duration, new over old */
+          time_scale = (transition->to > transition->from) ?
+            (to * duration) / ((transition->to - transition->from) * old_duration) : 0.0;
 
-  g_return_val_if_fail (animator != NULL, FALSE);
+          transition_rebase (transition, retargets, progress, to, time_scale);
+          continue;
+        }
 
-  if (animator->value_destroy_func)
-    (animator->value_destroy_func) (animator->user_data);
+      /* the rest keep their course, shifted and scaled in time */
+      transition->from = (transition->from - progress) / remaining;
+      transition->to = (transition->to - progress) / remaining;
 
-  animator->user_data = user_data;
-  animator->value_destroy_func = value_destroy_func;
+      for (j = 0; transition->keyframes && j < transition->keyframes->len; j++)
+        {
+          AfKeyframe *keyframe;
 
-  return TRUE;
-}
+          keyframe = &g_array_index (transition->keyframes, AfKeyframe, j);
+          keyframe->progress = (keyframe->progress - progress) / remaining;
+        }
 
-gboolean
-af_animator_set_finished_notify (guint anim_id,
-		                 AfFinishedAnimationNotify finished_notify)
-{
-  AfAnimator *animator;
+      if (!retargeted)
+        continue;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
+      /* not started yet, only the targets change */
+      for (j = 0; j < transition->properties->len; j++)
+        {
+          AfPropertyRange *property_range;
+          AfRetarget *retarget;
 
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (anim_id));
+          property_range = &g_array_index (transition->properties, AfPropertyRange, j);
+          retarget = retargets_find (retargets, property_range->pspec->name);
 
-  g_return_val_if_fail (animator != NULL, FALSE);
+          if (retarget &&
+              G_VALUE_TYPE (&retarget->value) == property_range->pspec->value_type)
+            g_value_copy (&retarget->value, &property_range->to);
+        }
+    }
 
-  animator->finished_notify = finished_notify;
+  animator->last_progress = 0.0;
+  animator->index_dirty = TRUE;
+
+  af_timeline_set_duration (animator->timeline, duration);
+  af_timeline_set_progress (animator->timeline, 0.0);
 
   return TRUE;
 }
 
-AfTransition*
-af_animator_add_transition_valist (guint                   anim_id,
-                                   gdouble                 from,
-                                   gdouble                 to,
-                                   AfTimelineProgressType  type,
-                                   GObject                *object,
-                                   va_list                 args)
+static gboolean
+animator_retarget_valist (AfAnimator   *animator,
+                          AfTransition *only_transition,
+                          guint         duration,
+                          va_list       args)
 {
-  AfAnimator *animator;
-  AfTransition *transition;
+  GArray *retargets;
+  gboolean result;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
-  g_return_val_if_fail (anim_id != 0, FALSE);
-  g_return_val_if_fail (from >= 0.0 && from <= 1.0, FALSE);
-  g_return_val_if_fail (to >= 0.0 && to <= 1.0, FALSE);
-  g_return_val_if_fail (from <= to, FALSE);
-  g_return_val_if_fail (G_IS_OBJECT (object), FALSE);
+  retargets = retargets_collect (animator, only_transition, args);
 
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (anim_id));
+  if (!retargets)
+    return FALSE;
 
-  g_return_val_if_fail (animator != NULL, FALSE);
+  result = animator_retarget (animator, only_transition, duration, retargets);
+  retargets_free (retargets);
 
-  transition = af_transition_new (object, NULL, from, to, type);
+  return result;
+}
 
-  transition_add_properties (transition, args);
+/* Changes target values of a running animator, in place. Values
+ * go on from where they are, numeric ones at their current speed,
+ * towards the new targets. @duration is the new remaining time,
+ * 0 keeps it. Other transitions keep their course in time.
+ */
+gboolean
+af_animator_retarget_valist (guint   anim_id,
+                             guint   duration,
+                             va_list args)
+{
+  AfAnimator *animator;
 
-  g_ptr_array_add (animator->transitions, transition);
+  animator = animator_lookup (anim_id);
 
-  return transition;
+  g_return_val_if_fail (animator != NULL, FALSE);
+
+  return animator_retarget_valist (animator, NULL, duration, args);
 }
 
-AfTransition*
-af_animator_add_transition (guint                   anim_id,
-                            gdouble                 from,
-                            gdouble                 to,
-                            AfTimelineProgressType  type,
-                            GObject                *object,
-                            ...)
+gboolean
+af_animator_retarget (guint anim_id,
+                      guint duration,
+                      ...)
 {
-  AfTransition *result;
+  gboolean result;
   va_list args;
 
-  va_start (args, object);
-  result = af_animator_add_transition_valist (anim_id,
-                                              from, to,
-                                              type,
-                                              object, args);
+  va_start (args, duration);
+  result = af_animator_retarget_valist (anim_id, duration, args);
   va_end (args);
 
-  va_start (args, object);
   return result;
 }
 
-AfTransition*
-af_animator_add_child_transition_valist (guint                    anim_id,
-                                         gdouble                  from,
-                                         gdouble                  to,
-                                         AfTimelineProgressType   type,
-                                         GtkContainer            *container,
-                                         GtkWidget               *child,
-                                         va_list                  args)
+/* Same as af_animator_retarget(), for a single transition */
+gboolean
+af_animator_retarget_transition (guint         anim_id,
+                                 AfTransition *transition,
+                                 guint         duration,
+                                 ...)
 {
   AfAnimator *animator;
-  AfTransition *transition;
+  gboolean result;
+  va_list args;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
-  g_return_val_if_fail (anim_id != 0, FALSE);
-  g_return_val_if_fail (from >= 0.0 && from <= 1.0, FALSE);
-  g_return_val_if_fail (to >= 0.0 && to <= 1.0, FALSE);
-  g_return_val_if_fail (from <= to, FALSE);
-  g_return_val_if_fail (GTK_IS_CONTAINER (container), FALSE);
-  g_return_val_if_fail (GTK_IS_WIDGET (child), FALSE);
+  g_return_val_if_fail (transition != NULL, FALSE);
 
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (anim_id));
+  animator = animator_lookup (anim_id);
 
   g_return_val_if_fail (animator != NULL, FALSE);
 
-  transition = af_transition_new (G_OBJECT (container),
-                                  G_OBJECT (child),
-                                  from, to,
-                                  type);
-
-  transition_add_properties (transition, args);
-
-  g_ptr_array_add (animator->transitions, transition);
-
-  return transition;
-}
-
-AfTransition*
-af_animator_add_child_transition (guint                   anim_id,
-                                  gdouble                 from,
-                                  gdouble                 to,
-                                  AfTimelineProgressType  type,
-                                  GtkContainer           *container,
-                                  GtkWidget              *child,
-                                  ...)
-{
-  AfTransition *result;
-  va_list args;
-
-  va_start (args, child);
-  result = af_animator_add_child_transition_valist (anim_id,
-                                                    from, to,
-                                                    type,
-                                                    container, child, args);
+  va_start (args, duration);
+  result = animator_retarget_valist (animator, transition, duration, args);
   va_end (args);
 
   return result;
@@ -608,15 +3446,21 @@ af_animator_remove_transition (guint         id,
 {
   AfAnimator *animator;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
   g_return_val_if_fail (transition != NULL, FALSE);
 
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_val_if_fail (animator != NULL, FALSE);
 
   if (g_ptr_array_remove (animator->transitions, transition) == FALSE)
-    return g_ptr_array_remove (animator->finished_transitions, transition);
+    return FALSE;
+
+  g_ptr_array_remove (animator->transitions_by_end, transition);
+  g_ptr_array_remove (animator->active_transitions, transition);
+  animator->index_dirty = TRUE;
+
+  if (transition->spring)
+    animator->n_springs--;
 
   return TRUE;
 }
@@ -627,17 +3471,18 @@ af_animator_start (guint id,
 {
   AfAnimator *animator;
 
-  g_return_val_if_fail (animators != NULL, FALSE);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_val_if_fail (animator != NULL, FALSE);
   g_return_val_if_fail (animator->timeline == NULL, FALSE);
 
   animator->timeline = af_timeline_new (duration);
 
-  g_signal_connect (animator->timeline, "frame",
-                    G_CALLBACK (animator_frame_cb), animator);
+  if (animator->clock)
+    af_timeline_set_clock (animator->timeline, animator->clock);
+
+  af_timeline_add_frame_func (animator->timeline,
+                              animator_frame_cb, animator, NULL);
   g_signal_connect_swapped (animator->timeline, "finished",
                             G_CALLBACK (af_animator_remove_with_notification),
                             GUINT_TO_POINTER (id));
@@ -652,9 +3497,7 @@ af_animator_pause (guint id)
 {
   AfAnimator *animator;
 
-  g_return_val_if_fail (animators != NULL, -1);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_val_if_fail (animator != NULL, -1);
 
@@ -668,9 +3511,7 @@ af_animator_resume (guint id)
 {
   AfAnimator *animator;
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
@@ -685,9 +3526,7 @@ af_animator_resume_with_progress (guint   id,
 
   g_return_if_fail (progress >= 0 && progress <= 1);
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
@@ -702,9 +3541,7 @@ af_animator_reverse (guint id)
   AfAnimator *animator;
   AfTimelineDirection direction;
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
@@ -724,9 +3561,7 @@ af_animator_advance (guint   id,
 {
   AfAnimator *animator;
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
@@ -736,9 +3571,12 @@ af_animator_advance (guint   id,
 void
 af_animator_remove (guint id)
 {
-  g_return_if_fail (animators != NULL);
+  AfAnimator *animator;
 
-  g_hash_table_remove (animators, GUINT_TO_POINTER (id));
+  animator = animator_slot_release (id);
+
+  if (animator)
+    af_animator_free (animator);
 }
 
 static void 
@@ -746,16 +3584,18 @@ af_animator_remove_with_notification (guint id)
 {
   AfAnimator *animator;
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
+  /* the last frame is in place before notifying */
+  _af_animator_run_commit ();
+
   if (animator->finished_notify)
     (animator->finished_notify) (id, animator->user_data);
 
-  g_hash_table_remove (animators, GUINT_TO_POINTER (id));
+  /* the notify function might have removed it already */
+  af_animator_remove (id);
 }
 
 void
@@ -764,15 +3604,267 @@ af_animator_set_loop (guint    id,
 {
   AfAnimator *animator;
 
-  g_return_if_fail (animators != NULL);
-
-  animator = g_hash_table_lookup (animators, GUINT_TO_POINTER (id));
+  animator = animator_lookup (id);
 
   g_return_if_fail (animator != NULL);
 
   af_timeline_set_loop (animator->timeline, loop);
 }
 
+/* The posted value is converted to the type of the property */
+static void
+animator_run_retarget (AfAnimator    *animator,
+                       AfCommandNode *node)
+{
+  AfRetarget retarget = { 0, };
+  GParamSpec *pspec;
+  GArray *retargets;
+
+  pspec = animator_find_pspec (animator, NULL, node->property_name);
+
+  if (!pspec)
+    {
+      g_warning ("Property '%s' is not animated by this animator",
+                 node->property_name);
+      return;
+    }
+
+  retarget.property_name = node->property_name;
+  g_value_init (&retarget.value, pspec->value_type);
+
+  if (!g_value_transform (&node->target, &retarget.value))
+    {
+      g_warning ("Can not retarget property '%s' of type '%s' to a value of type '%s'",
+                 node->property_name, g_type_name (pspec->value_type),
+                 G_VALUE_TYPE_NAME (&node->target));
+      g_value_unset (&retarget.value);
+      return;
+    }
+
+  retargets = g_array_new (FALSE, TRUE, sizeof (AfRetarget));
+  g_array_append_val (retargets, retarget);
+
+  animator_retarget (animator, NULL, (guint) MAX (node->value, 0), retargets);
+  retargets_free (retargets);
+}
+
+static void
+animator_run_command (AfCommandNode *node)
+{
+  AfAnimator *animator;
+
+  /* the animator may have finished since, that is fine */
+  animator = animator_lookup (node->id);
+
+  if (!animator)
+    return;
+
+  /* only START applies before starting, and only once */
+  if (node->command == AF_ANIMATOR_COMMAND_START)
+    {
+      if (animator->timeline)
+        return;
+    }
+  else if (!animator->timeline &&
+           node->command != AF_ANIMATOR_COMMAND_RETARGET &&
+           node->command != AF_ANIMATOR_COMMAND_REMOVE)
+    return;
+
+  switch (node->command)
+    {
+    case AF_ANIMATOR_COMMAND_START:
+      af_animator_start (node->id, (guint) MAX (node->value, 0));
+      break;
+    case AF_ANIMATOR_COMMAND_PAUSE:
+      af_animator_pause (node->id);
+      break;
+    case AF_ANIMATOR_COMMAND_RESUME:
+      af_animator_resume (node->id);
+      break;
+    case AF_ANIMATOR_COMMAND_RESUME_WITH_PROGRESS:
+      af_animator_resume_with_progress (node->id, CLAMP (node->value, 0., 1.));
+      break;
+    case AF_ANIMATOR_COMMAND_REVERSE:
+      af_animator_reverse (node->id);
+      break;
+    case AF_ANIMATOR_COMMAND_ADVANCE:
+      af_animator_advance (node->id, CLAMP (node->value, 0., 1.));
+      break;
+    case AF_ANIMATOR_COMMAND_SET_LOOP:
+      af_animator_set_loop (node->id, node->value != 0);
+      break;
+    case AF_ANIMATOR_COMMAND_RETARGET:
+      animator_run_retarget (animator, node);
+      break;
+    case AF_ANIMATOR_COMMAND_REMOVE:
+      af_animator_remove (node->id);
+      break;
+    }
+}
+
+static void
+command_node_free (AfCommandNode *node)
+{
+  if (node->property_name)
+    {
+      g_free (node->property_name);
+      g_value_unset (&node->target);
+    }
+
+  g_slice_free (AfCommandNode, node);
+}
+
+void
+_af_animator_run_commands (void)
+{
+  AfCommandNode *list, *node, *ordered;
+
+  do
+    list = g_atomic_pointer_get (&command_queue);
+  while (list &&
+         !g_atomic_pointer_compare_and_exchange ((gpointer *) &command_queue,
+                                                 list, NULL));
+
+  /* the stack has the latest command first */
+  ordered = NULL;
+
+  while (list)
+    {
+      node = list;
+      list = node->next;
+      node->next = ordered;
+      ordered = node;
+    }
+
+  while (ordered)
+    {
+      node = ordered;
+      ordered = node->next;
+
+      animator_run_command (node);
+      command_node_free (node);
+    }
+}
+
+static gboolean
+command_source_prepare (GSource *source,
+                        gint    *timeout)
+{
+  *timeout = -1;
+
+  return (g_atomic_pointer_get (&command_queue) != NULL);
+}
+
+static gboolean
+command_source_check (GSource *source)
+{
+  return (g_atomic_pointer_get (&command_queue) != NULL);
+}
+
+static gboolean
+command_source_dispatch (GSource     *source,
+                         GSourceFunc  callback,
+                         gpointer     user_data)
+{
+  gdk_threads_enter ();
+  _af_animator_run_commands ();
+  gdk_threads_leave ();
+
+  return TRUE;
+}
+
+static GSourceFuncs command_source_funcs = {
+  command_source_prepare,
+  command_source_check,
+  command_source_dispatch,
+  NULL
+};
+
+static void
+command_push (AfCommandNode *node)
+{
+  AfCommandNode *head;
+
+  if (g_once_init_enter (&command_source_attached))
+    {
+      GSource *source;
+
+      source = g_source_new (&command_source_funcs, sizeof (GSource));
+      g_source_attach (source, NULL);
+      g_source_unref (source);
+
+      g_once_init_leave (&command_source_attached, 1);
+    }
+
+  do
+    {
+      head = g_atomic_pointer_get (&command_queue);
+      node->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange ((gpointer *) &command_queue,
+                                                 head, node));
+
+  /* the first command in the stack wakes the main loop up,
+   * later ones will be taken along with it.
+   */
+  if (!head)
+    g_main_context_wakeup (NULL);
+}
+
+/* Queues @command to run on the animator from the main loop, at the
+ * latest right before the next frame, in posting order. Unlike the
+ * other functions, this one may be called from any thread and never
+ * blocks. @value is the duration for START, the progress for ADVANCE
+ * and RESUME_WITH_PROGRESS, and non-zero to loop for SET_LOOP.
+ * RETARGET carries a value, it is posted with af_animator_post_retarget().
+ * Commands for animators removed in the meanwhile are dropped.
+ */
+void
+af_animator_post_command (guint             id,
+                          AfAnimatorCommand command,
+                          gdouble           value)
+{
+  AfCommandNode *node;
+
+  g_return_if_fail (id != 0);
+  g_return_if_fail (command != AF_ANIMATOR_COMMAND_RETARGET);
+
+  node = g_slice_new0 (AfCommandNode);
+  node->id = id;
+  node->command = command;
+  node->value = value;
+
+  command_push (node);
+}
+
+/* Queues a RETARGET command, af_animator_retarget() of a single
+ * property from any thread. @value is copied, and converted to the
+ * property type once run. Failures are only warned about, as there
+ * is no one to return them to.
+ */
+void
+af_animator_post_retarget (guint         id,
+                           guint         duration,
+                           const gchar  *property_name,
+                           const GValue *value)
+{
+  AfCommandNode *node;
+
+  g_return_if_fail (id != 0);
+  g_return_if_fail (property_name != NULL);
+  g_return_if_fail (G_IS_VALUE (value));
+
+  node = g_slice_new0 (AfCommandNode);
+  node->id = id;
+  node->command = AF_ANIMATOR_COMMAND_RETARGET;
+  node->value = duration;
+  node->property_name = g_strdup (property_name);
+  g_value_init (&node->target, G_VALUE_TYPE (value));
+  g_value_copy (value, &node->target);
+
+  command_push (node);
+}
+
 guint
 af_animator_tween (GObject                  *object,
                    guint                     duration,
@@ -813,6 +3905,50 @@ af_animator_tween (GObject                  *object,
 
 }
 
+guint
+af_animator_spring (GObject                  *object,
+                    gdouble                   stiffness,
+                    gdouble                   damping,
+                    gdouble                   mass,
+                    gpointer                  user_data,
+                    GDestroyNotify            value_destroy_func,
+                    AfFinishedAnimationNotify finished_notify,
+                    ...)
+{
+  AfTransition *transition;
+  va_list args;
+  guint anim_id;
+
+  g_return_val_if_fail (G_IS_OBJECT (object), 0);
+
+  anim_id = af_animator_add ();
+
+  if (user_data)
+    af_animator_set_user_data (anim_id,
+                               user_data,
+                               value_destroy_func);
+
+  if (finished_notify)
+    af_animator_set_finished_notify (anim_id,
+                                     finished_notify);
+
+  va_start (args, finished_notify);
+  transition = af_animator_add_spring_transition_valist (anim_id,
+                                                         stiffness, damping, mass,
+                                                         object, args);
+  va_end (args);
+
+  if (!transition)
+    {
+      af_animator_remove (anim_id);
+      return 0;
+    }
+
+  af_animator_start (anim_id, AF_ANIMATOR_SPRING_MAX_DURATION);
+
+  return anim_id;
+}
+
 guint
 af_animator_child_tween (GtkContainer             *container,
                          GtkWidget                *child,
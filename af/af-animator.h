@@ -23,6 +23,7 @@
 #include <glib.h>
 #include <gtk/gtk.h>
 #include "af-enums.h"
+#include "af-clock.h"
 
 G_BEGIN_DECLS
 
@@ -34,11 +35,37 @@ typedef void (*AfTypeTransformationFunc) (const GValue *from,
 					  gpointer      user_data,
                                           GValue       *out_value);
 
+/* writes the result into @out_boxed, an instance of the boxed type */
+typedef void (*AfTypeInPlaceTransformationFunc) (const GValue *from,
+                                                 const GValue *to,
+                                                 gdouble       progress,
+                                                 gpointer      user_data,
+                                                 gpointer      out_boxed);
+
 typedef	void (*AfFinishedAnimationNotify) (guint    anim_id,
 		                           gpointer user_data);
 
+typedef void (*AfLocationChangedFunc) (gpointer user_data);
+
+/* Duration af_animator_spring() gives springs to come to rest, in ms */
+#define AF_ANIMATOR_SPRING_MAX_DURATION 3600000
+
+typedef struct AfKeyframe AfKeyframe;
+
+/* A value at a point of the animator progress. type eases
+ * the segment that ends at this keyframe.
+ */
+struct AfKeyframe
+{
+  gdouble progress;
+  gdouble value;
+  AfTimelineProgressType type;
+};
+
 void  af_animator_register_type_transformation (GType                    type,
                                                 AfTypeTransformationFunc trans_func);
+void  af_animator_register_type_transformation_in_place (GType                           type,
+                                                         AfTypeInPlaceTransformationFunc trans_func);
 
 guint    af_animator_add                         (void);
 
@@ -69,6 +96,55 @@ AfTransition* af_animator_add_child_transition   (guint                   anim_i
                                                   GtkContainer           *container,
                                                   GtkWidget              *child,
                                                   ...);
+AfTransition* af_animator_add_location_transition_valist (guint                   anim_id,
+                                                          gdouble                 from,
+                                                          gdouble                 to,
+                                                          AfTimelineProgressType  type,
+                                                          AfLocationChangedFunc   changed_func,
+                                                          gpointer                user_data,
+                                                          va_list                 var_args);
+AfTransition* af_animator_add_location_transition  (guint                   anim_id,
+                                                    gdouble                 from,
+                                                    gdouble                 to,
+                                                    AfTimelineProgressType  type,
+                                                    AfLocationChangedFunc   changed_func,
+                                                    gpointer                user_data,
+                                                    ...);
+
+AfTransition* af_animator_add_keyframe_transition (guint                   anim_id,
+                                                  GObject                *object,
+                                                  const gchar            *property_name,
+                                                  const AfKeyframe       *keyframes,
+                                                  guint                   n_keyframes);
+
+AfTransition* af_animator_add_spring_transition_valist (guint                   anim_id,
+                                                        gdouble                 stiffness,
+                                                        gdouble                 damping,
+                                                        gdouble                 mass,
+                                                        GObject                *object,
+                                                        va_list                 var_args);
+AfTransition* af_animator_add_spring_transition  (guint                   anim_id,
+                                                  gdouble                 stiffness,
+                                                  gdouble                 damping,
+                                                  gdouble                 mass,
+                                                  GObject                *object,
+                                                  ...);
+gboolean      af_animator_set_spring_target      (guint                   anim_id,
+                                                  AfTransition           *transition,
+                                                  const gchar            *property_name,
+                                                  gdouble                 target);
+
+gboolean      af_animator_retarget_valist        (guint                   anim_id,
+                                                  guint                   duration,
+                                                  va_list                 var_args);
+gboolean      af_animator_retarget               (guint                   anim_id,
+                                                  guint                   duration,
+                                                  ...);
+gboolean      af_animator_retarget_transition    (guint                   anim_id,
+                                                  AfTransition           *transition,
+                                                  guint                   duration,
+                                                  ...);
+
 gboolean      af_animator_remove_transition      (guint         id,
 		                                  AfTransition *transition);
 
@@ -82,6 +158,16 @@ gboolean af_animator_set_user_data               (guint          anim_id,
 gboolean af_animator_set_finished_notify         (guint                     anim_id,
 		                                  AfFinishedAnimationNotify finished_notify);
 
+guint    af_animator_get_frame_allocations       (guint         anim_id);
+void     af_animator_get_frame_timings           (gint64       *evaluate_time,
+                                                  gint64       *commit_time);
+
+gboolean af_animator_set_clock                   (guint         anim_id,
+                                                  AfClock      *clock);
+
+gboolean af_animator_set_parallel                (guint         anim_id,
+                                                  gboolean      parallel);
+
 void     af_animator_remove                      (guint         id);
 gdouble  af_animator_pause                       (guint         id);
 void     af_animator_resume                      (guint         id);
@@ -94,6 +180,14 @@ void     af_animator_advance                     (guint         id,
 void     af_animator_set_loop                    (guint         id,
                                                   gboolean      loop);
 
+void     af_animator_post_command                (guint              id,
+                                                  AfAnimatorCommand  command,
+                                                  gdouble            value);
+void     af_animator_post_retarget               (guint              id,
+                                                  guint              duration,
+                                                  const gchar       *property_name,
+                                                  const GValue      *value);
+
 /* Helper functions */
 guint    af_animator_tween                       (GObject                  *object,
                                                   guint                     duration,
@@ -102,6 +196,14 @@ guint    af_animator_tween                       (GObject                  *obje
 		                                  GDestroyNotify            value_destroy_func,
                                                   AfFinishedAnimationNotify finished_notify,
                                                   ...);
+guint    af_animator_spring                      (GObject                  *object,
+                                                  gdouble                   stiffness,
+                                                  gdouble                   damping,
+                                                  gdouble                   mass,
+                                                  gpointer                  user_data,
+                                                  GDestroyNotify            value_destroy_func,
+                                                  AfFinishedAnimationNotify finished_notify,
+                                                  ...);
 guint    af_animator_child_tween                 (GtkContainer             *container,
                                                   GtkWidget                *child,
                                                   guint                     duration,
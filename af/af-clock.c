@@ -0,0 +1,446 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* af-clock.c
+ *
+ * Copyright (C) 2007 Carlos Garnacho <carlos@imendio.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* An AfClock provides the time base for the timelines bound to
+ * it, and advances all of its running timelines in one pass on
+ * every tick. Where ticks come from is up to the implementation:
+ * the default clock runs off the GLib main loop in real time,
+ * while the manual and external clocks are driven by the caller,
+ * which makes animations testable without a display or sleeps.
+ */
+
+#include <gtk/gtk.h>
+#include <glib-object.h>
+#include "af-clock.h"
+#include "af-timeline.h"
+#include "af-private.h"
+
+#define AF_CLOCK_GET_PRIV(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), AF_TYPE_CLOCK, AfClockPriv))
+#define AF_MANUAL_CLOCK_GET_PRIV(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), AF_TYPE_MANUAL_CLOCK, AfManualClockPriv))
+#define AF_EXTERNAL_CLOCK_GET_PRIV(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), AF_TYPE_EXTERNAL_CLOCK, AfExternalClockPriv))
+
+typedef struct AfClockPriv AfClockPriv;
+typedef struct AfManualClockPriv AfManualClockPriv;
+typedef struct AfExternalClockPriv AfExternalClockPriv;
+
+struct AfClockPriv
+{
+  GPtrArray *timelines;
+
+  /* timelines being dispatched in the current tick,
+   * kept around so ticking does not allocate.
+   */
+  GPtrArray *dispatching;
+
+  guint in_dispatch : 1;
+};
+
+struct AfManualClockPriv
+{
+  gint64 time;
+};
+
+struct AfExternalClockPriv
+{
+  gint64 time;
+};
+
+static void  af_clock_finalize      (GObject *object);
+
+static gint64 af_manual_clock_get_time   (AfClock *clock);
+static gint64 af_external_clock_get_time (AfClock *clock);
+
+
+G_DEFINE_ABSTRACT_TYPE (AfClock, af_clock, G_TYPE_OBJECT)
+G_DEFINE_TYPE (AfManualClock, af_manual_clock, AF_TYPE_CLOCK)
+G_DEFINE_TYPE (AfExternalClock, af_external_clock, AF_TYPE_CLOCK)
+
+
+static void
+af_clock_class_init (AfClockClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = af_clock_finalize;
+
+  g_type_class_add_private (class, sizeof (AfClockPriv));
+}
+
+static void
+af_clock_init (AfClock *clock)
+{
+  AfClockPriv *priv;
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  priv->timelines = g_ptr_array_new ();
+  priv->dispatching = g_ptr_array_new ();
+}
+
+static void
+af_clock_finalize (GObject *object)
+{
+  AfClockPriv *priv;
+
+  priv = AF_CLOCK_GET_PRIV (object);
+
+  /* running timelines hold a reference on their clock */
+  g_assert (priv->timelines->len == 0);
+
+  g_ptr_array_free (priv->timelines, TRUE);
+  g_ptr_array_free (priv->dispatching, TRUE);
+
+  G_OBJECT_CLASS (af_clock_parent_class)->finalize (object);
+}
+
+static void
+clock_schedule (AfClock *clock)
+{
+  AfClockPriv *priv;
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  /* done once the current tick finishes */
+  if (priv->in_dispatch)
+    return;
+
+  if (AF_CLOCK_GET_CLASS (clock)->schedule)
+    (AF_CLOCK_GET_CLASS (clock)->schedule) (clock);
+}
+
+/**
+ * af_clock_get_default:
+ *
+ * Returns the clock timelines are bound to unless told
+ * otherwise. It ticks in real time from the GLib main
+ * loop, at the highest frame rate its timelines request.
+ *
+ * Return Value: the default #AfClock, owned by the library
+ **/
+AfClock *
+af_clock_get_default (void)
+{
+  static AfClock *default_clock = NULL;
+
+  if (G_UNLIKELY (!default_clock))
+    default_clock = g_object_new (_af_master_clock_get_type (), NULL);
+
+  return default_clock;
+}
+
+/**
+ * af_clock_get_time:
+ * @clock: A #AfClock
+ *
+ * Returns the current time of the clock.
+ *
+ * Return Value: time in microseconds
+ **/
+gint64
+af_clock_get_time (AfClock *clock)
+{
+  g_return_val_if_fail (AF_IS_CLOCK (clock), 0);
+
+  return (AF_CLOCK_GET_CLASS (clock)->get_time) (clock);
+}
+
+/**
+ * af_clock_get_fps:
+ * @clock: A #AfClock
+ *
+ * Returns the highest frame rate requested by the
+ * running timelines bound to @clock, or 0 if none
+ * is running.
+ *
+ * Return Value: frames per second
+ **/
+guint
+af_clock_get_fps (AfClock *clock)
+{
+  AfClockPriv *priv;
+  guint i, fps = 0;
+
+  g_return_val_if_fail (AF_IS_CLOCK (clock), 0);
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  for (i = 0; i < priv->timelines->len; i++)
+    fps = MAX (fps, af_timeline_get_fps (g_ptr_array_index (priv->timelines, i)));
+
+  return fps;
+}
+
+/**
+ * af_clock_is_active:
+ * @clock: A #AfClock
+ *
+ * Returns whether there are running timelines
+ * bound to @clock, and so whether it needs to tick.
+ *
+ * Return Value: %TRUE if the clock has work to do
+ **/
+gboolean
+af_clock_is_active (AfClock *clock)
+{
+  AfClockPriv *priv;
+
+  g_return_val_if_fail (AF_IS_CLOCK (clock), FALSE);
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  return (priv->timelines->len > 0);
+}
+
+/**
+ * af_clock_dispatch:
+ * @clock: A #AfClock
+ * @frame_time: time of the frame, in microseconds
+ *
+ * Advances every running timeline bound to @clock to
+ * @frame_time. This is meant for clock implementations.
+ **/
+void
+af_clock_dispatch (AfClock *clock,
+                   gint64   frame_time)
+{
+  AfClockPriv *priv;
+  guint i;
+
+  g_return_if_fail (AF_IS_CLOCK (clock));
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  g_return_if_fail (priv->in_dispatch == FALSE);
+
+  /* commands posted from other threads apply to this frame,
+   * whichever clock drives it.
+   */
+  _af_animator_run_commands ();
+
+  g_object_ref (clock);
+  priv->in_dispatch = TRUE;
+
+  /* Timelines may be started, paused or destroyed from
+   * within their own handlers, so work on a referenced
+   * snapshot and skip the ones that left the tick set.
+   */
+  for (i = 0; i < priv->timelines->len; i++)
+    g_ptr_array_add (priv->dispatching,
+                     g_object_ref (g_ptr_array_index (priv->timelines, i)));
+
+  for (i = 0; i < priv->dispatching->len; i++)
+    {
+      AfTimeline *timeline;
+
+      timeline = g_ptr_array_index (priv->dispatching, i);
+
+      if (af_timeline_is_running (timeline) &&
+          af_timeline_get_clock (timeline) == clock)
+        _af_timeline_run_frame (timeline, frame_time);
+    }
+
+  /* animators evaluated above get written out in one go */
+  _af_animator_run_commit ();
+
+  for (i = 0; i < priv->dispatching->len; i++)
+    g_object_unref (g_ptr_array_index (priv->dispatching, i));
+
+  g_ptr_array_set_size (priv->dispatching, 0);
+
+  priv->in_dispatch = FALSE;
+
+  /* the tick set may have changed */
+  clock_schedule (clock);
+
+  g_object_unref (clock);
+}
+
+void
+_af_clock_add_timeline (AfClock    *clock,
+                        AfTimeline *timeline)
+{
+  AfClockPriv *priv;
+
+  g_return_if_fail (AF_IS_CLOCK (clock));
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  g_ptr_array_add (priv->timelines, timeline);
+  clock_schedule (clock);
+}
+
+void
+_af_clock_remove_timeline (AfClock    *clock,
+                           AfTimeline *timeline)
+{
+  AfClockPriv *priv;
+
+  g_return_if_fail (AF_IS_CLOCK (clock));
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+
+  priv = AF_CLOCK_GET_PRIV (clock);
+
+  if (g_ptr_array_remove_fast (priv->timelines, timeline))
+    clock_schedule (clock);
+}
+
+void
+_af_clock_update (AfClock *clock)
+{
+  g_return_if_fail (AF_IS_CLOCK (clock));
+
+  clock_schedule (clock);
+}
+
+/* Manual clock */
+static void
+af_manual_clock_class_init (AfManualClockClass *class)
+{
+  AfClockClass *clock_class = AF_CLOCK_CLASS (class);
+
+  clock_class->get_time = af_manual_clock_get_time;
+
+  g_type_class_add_private (class, sizeof (AfManualClockPriv));
+}
+
+static void
+af_manual_clock_init (AfManualClock *clock)
+{
+}
+
+static gint64
+af_manual_clock_get_time (AfClock *clock)
+{
+  AfManualClockPriv *priv;
+
+  priv = AF_MANUAL_CLOCK_GET_PRIV (clock);
+
+  return priv->time;
+}
+
+/**
+ * af_manual_clock_new:
+ *
+ * Creates a clock whose time starts at 0 and only moves
+ * forward through af_manual_clock_advance().
+ *
+ * Return Value: the newly created #AfClock
+ **/
+AfClock *
+af_manual_clock_new (void)
+{
+  return g_object_new (AF_TYPE_MANUAL_CLOCK, NULL);
+}
+
+/**
+ * af_manual_clock_advance:
+ * @clock: A manual #AfClock
+ * @usecs: time to advance, in microseconds
+ *
+ * Moves the clock forward by @usecs and runs one frame
+ * on all of its running timelines.
+ **/
+void
+af_manual_clock_advance (AfClock *clock,
+                         gint64   usecs)
+{
+  AfManualClockPriv *priv;
+
+  g_return_if_fail (AF_IS_MANUAL_CLOCK (clock));
+  g_return_if_fail (usecs >= 0);
+
+  priv = AF_MANUAL_CLOCK_GET_PRIV (clock);
+
+  priv->time += usecs;
+  af_clock_dispatch (clock, priv->time);
+}
+
+/* External clock */
+static void
+af_external_clock_class_init (AfExternalClockClass *class)
+{
+  AfClockClass *clock_class = AF_CLOCK_CLASS (class);
+
+  clock_class->get_time = af_external_clock_get_time;
+
+  g_type_class_add_private (class, sizeof (AfExternalClockPriv));
+}
+
+static void
+af_external_clock_init (AfExternalClock *clock)
+{
+  AfExternalClockPriv *priv;
+
+  priv = AF_EXTERNAL_CLOCK_GET_PRIV (clock);
+
+  priv->time = g_get_monotonic_time ();
+}
+
+static gint64
+af_external_clock_get_time (AfClock *clock)
+{
+  AfExternalClockPriv *priv;
+
+  priv = AF_EXTERNAL_CLOCK_GET_PRIV (clock);
+
+  return priv->time;
+}
+
+/**
+ * af_external_clock_new:
+ *
+ * Creates a clock that ticks on timestamps fed by the
+ * caller through af_external_clock_tick(). Until the
+ * first tick its time is the monotonic time at creation.
+ *
+ * Return Value: the newly created #AfClock
+ **/
+AfClock *
+af_external_clock_new (void)
+{
+  return g_object_new (AF_TYPE_EXTERNAL_CLOCK, NULL);
+}
+
+/**
+ * af_external_clock_tick:
+ * @clock: An external #AfClock
+ * @frame_time: presentation time of the frame, in microseconds
+ *
+ * Sets the clock time to @frame_time and runs one frame
+ * on all of its running timelines. Timestamps must not
+ * go backwards.
+ **/
+void
+af_external_clock_tick (AfClock *clock,
+                        gint64   frame_time)
+{
+  AfExternalClockPriv *priv;
+
+  g_return_if_fail (AF_IS_EXTERNAL_CLOCK (clock));
+
+  priv = AF_EXTERNAL_CLOCK_GET_PRIV (clock);
+
+  g_return_if_fail (frame_time >= priv->time);
+
+  priv->time = frame_time;
+  af_clock_dispatch (clock, priv->time);
+}
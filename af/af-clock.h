@@ -0,0 +1,120 @@
+/* afclock.h
+ *
+ * Copyright (C) 2007 Carlos Garnacho <carlos@imendio.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AF_CLOCK_H__
+#define __AF_CLOCK_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define AF_TYPE_CLOCK                    (af_clock_get_type ())
+#define AF_CLOCK(obj)                    (G_TYPE_CHECK_INSTANCE_CAST ((obj), AF_TYPE_CLOCK, AfClock))
+#define AF_CLOCK_CLASS(klass)            (G_TYPE_CHECK_CLASS_CAST ((klass), AF_TYPE_CLOCK, AfClockClass))
+#define AF_IS_CLOCK(obj)                 (G_TYPE_CHECK_INSTANCE_TYPE ((obj), AF_TYPE_CLOCK))
+#define AF_IS_CLOCK_CLASS(klass)         (G_TYPE_CHECK_CLASS_TYPE ((klass), AF_TYPE_CLOCK))
+#define AF_CLOCK_GET_CLASS(obj)          (G_TYPE_INSTANCE_GET_CLASS ((obj), AF_TYPE_CLOCK, AfClockClass))
+
+#define AF_TYPE_MANUAL_CLOCK             (af_manual_clock_get_type ())
+#define AF_MANUAL_CLOCK(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), AF_TYPE_MANUAL_CLOCK, AfManualClock))
+#define AF_IS_MANUAL_CLOCK(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), AF_TYPE_MANUAL_CLOCK))
+
+#define AF_TYPE_EXTERNAL_CLOCK           (af_external_clock_get_type ())
+#define AF_EXTERNAL_CLOCK(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), AF_TYPE_EXTERNAL_CLOCK, AfExternalClock))
+#define AF_IS_EXTERNAL_CLOCK(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), AF_TYPE_EXTERNAL_CLOCK))
+
+typedef struct AfClock                   AfClock;
+typedef struct AfClockClass              AfClockClass;
+typedef struct AfManualClock             AfManualClock;
+typedef struct AfManualClockClass        AfManualClockClass;
+typedef struct AfExternalClock           AfExternalClock;
+typedef struct AfExternalClockClass      AfExternalClockClass;
+
+struct AfClock
+{
+  GObject parent_instance;
+};
+
+struct AfClockClass
+{
+  GObjectClass parent_class;
+
+  /* current time in microseconds */
+  gint64 (* get_time)        (AfClock *clock);
+
+  /* the set of running timelines, or their fps, changed */
+  void   (* schedule)        (AfClock *clock);
+
+  void (* __gtk_reserved1) (void);
+  void (* __gtk_reserved2) (void);
+  void (* __gtk_reserved3) (void);
+  void (* __gtk_reserved4) (void);
+};
+
+/* Time only moves when told to through
+ * af_manual_clock_advance(), starting at 0.
+ */
+struct AfManualClock
+{
+  AfClock parent_instance;
+};
+
+struct AfManualClockClass
+{
+  AfClockClass parent_class;
+};
+
+/* Ticks on caller supplied timestamps, e.g. from
+ * a compositor or a video/audio presentation clock.
+ */
+struct AfExternalClock
+{
+  AfClock parent_instance;
+};
+
+struct AfExternalClockClass
+{
+  AfClockClass parent_class;
+};
+
+
+GType                 af_clock_get_type              (void) G_GNUC_CONST;
+GType                 af_manual_clock_get_type       (void) G_GNUC_CONST;
+GType                 af_external_clock_get_type     (void) G_GNUC_CONST;
+
+AfClock              *af_clock_get_default           (void);
+
+gint64                af_clock_get_time              (AfClock                 *clock);
+guint                 af_clock_get_fps               (AfClock                 *clock);
+gboolean              af_clock_is_active             (AfClock                 *clock);
+void                  af_clock_dispatch              (AfClock                 *clock,
+                                                      gint64                   frame_time);
+
+AfClock              *af_manual_clock_new            (void);
+void                  af_manual_clock_advance        (AfClock                 *clock,
+                                                      gint64                   usecs);
+
+AfClock              *af_external_clock_new          (void);
+void                  af_external_clock_tick         (AfClock                 *clock,
+                                                      gint64                   frame_time);
+
+G_END_DECLS
+
+#endif /* __AF_CLOCK_H__ */
@@ -0,0 +1,608 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* af-easing.c
+ *
+ * Copyright (C) 2007 Carlos Garnacho <carlos@imendio.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Easing kernels. All curves are evaluated as plain polynomials
+ * so that the scalar, SSE2 and AVX2 code paths do the very same
+ * operations in the same order, and give bitwise equal results.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include "af-timeline.h"
+#include "af-private.h"
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define AF_HAVE_SSE2 1
+#endif
+
+#if defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define AF_HAVE_AVX2 1
+#endif
+
+/* sin (x * PI / 2) on [0, 1]: odd Taylor polynomial up to x^11,
+ * with the last coefficient adjusted so that 0 and 1 map exactly
+ * to 0 and 1. Max error is 3.5e-9, below what sinf() provided.
+ */
+#define SIN_C1   1.5707963267948966
+#define SIN_C3  -0.6459640975062462
+#define SIN_C5   0.07969262624616703
+#define SIN_C7  -0.004681754135318687
+#define SIN_C9   0.00016044118478735975
+#define SIN_C11 -3.542584286142514e-06
+
+static inline gdouble
+ease_sinusoidal (gdouble x)
+{
+  gdouble x2 = x * x;
+
+  return x * (SIN_C1 + x2 * (SIN_C3 + x2 * (SIN_C5 + x2 * (SIN_C7 +
+              x2 * (SIN_C9 + x2 * SIN_C11)))));
+}
+
+static inline gdouble
+ease_in_ease_out (gdouble x)
+{
+  x *= 2;
+
+  if (x < 1)
+    return x * x * x / 2;
+
+  x -= 2;
+
+  return (x * x * x + 2) / 2;
+}
+
+/* Registered curves. Their progress types start at CURVE_FIRST_ID,
+ * built-in kernels leave those values untouched so they can be
+ * looked up afterwards. Bezier and sampled curves are compiled into
+ * a table of CURVE_TABLE_SIZE intervals that is interpolated
+ * linearly, steps are exact.
+ */
+#define CURVE_FIRST_ID    0x100
+#define CURVE_TABLE_SIZE  256
+
+typedef struct AfEasingCurve AfEasingCurve;
+
+struct AfEasingCurve
+{
+  guint n_steps;
+  guint jump_start : 1;
+
+  gdouble table[CURVE_TABLE_SIZE + 1];
+};
+
+/* Readers don't lock: a curve is in place before n_curves is
+ * bumped, and the array is replaced rather than reallocated.
+ * Replaced arrays are never freed, readers may still be on them.
+ */
+static AfEasingCurve ** volatile curves = NULL;
+static volatile guint n_curves = 0;
+static guint curves_size = 0;
+static GHashTable *curves_by_key = NULL;
+G_LOCK_DEFINE_STATIC (curves);
+
+static inline gdouble
+easing_builtin (gdouble                linear_progress,
+                AfTimelineProgressType progress_type)
+{
+  switch (progress_type)
+    {
+    case AF_TIMELINE_PROGRESS_SINUSOIDAL:
+      return ease_sinusoidal (linear_progress);
+    case AF_TIMELINE_PROGRESS_EXPONENTIAL:
+      return linear_progress * linear_progress;
+    case AF_TIMELINE_PROGRESS_EASE_IN_EASE_OUT:
+      return ease_in_ease_out (linear_progress);
+    case AF_TIMELINE_PROGRESS_LINEAR:
+    default:
+      return linear_progress;
+    }
+}
+
+static inline AfEasingCurve *
+easing_curve_lookup (AfTimelineProgressType progress_type)
+{
+  guint index = (guint) progress_type - CURVE_FIRST_ID;
+
+  if (index >= __atomic_load_n (&n_curves, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  return ((AfEasingCurve **) g_atomic_pointer_get (&curves))[index];
+}
+
+static inline gdouble
+easing_curve_evaluate (const AfEasingCurve *curve,
+                       gdouble              x)
+{
+  gdouble step;
+  guint i;
+
+  x = CLAMP (x, 0., 1.);
+
+  if (curve->n_steps > 0)
+    {
+      step = floor (x * curve->n_steps);
+
+      if (curve->jump_start)
+        step += 1;
+
+      return MIN (step, curve->n_steps) / curve->n_steps;
+    }
+
+  x *= CURVE_TABLE_SIZE;
+  i = (guint) x;
+
+  if (i >= CURVE_TABLE_SIZE)
+    return curve->table[CURVE_TABLE_SIZE];
+
+  return curve->table[i] + (curve->table[i + 1] - curve->table[i]) * (x - i);
+}
+
+gdouble
+_af_easing_calculate (gdouble                linear_progress,
+                      AfTimelineProgressType progress_type)
+{
+  AfEasingCurve *curve;
+
+  if (G_LIKELY ((guint) progress_type < CURVE_FIRST_ID))
+    return easing_builtin (linear_progress, progress_type);
+
+  curve = easing_curve_lookup (progress_type);
+
+  if (!curve)
+    return linear_progress;
+
+  return easing_curve_evaluate (curve, linear_progress);
+}
+
+static void
+easing_batch_scalar (const gdouble                *linear_progress,
+                     const AfTimelineProgressType *progress_types,
+                     gdouble                      *progress,
+                     guint                         n_values)
+{
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    progress[i] = easing_builtin (linear_progress[i], progress_types[i]);
+}
+
+#ifdef AF_HAVE_SSE2
+
+/* mask ? a : b */
+#define SSE2_SELECT(mask, a, b) \
+  _mm_or_pd (_mm_and_pd ((mask), (a)), _mm_andnot_pd ((mask), (b)))
+
+static void
+easing_batch_sse2 (const gdouble                *linear_progress,
+                   const AfTimelineProgressType *progress_types,
+                   gdouble                      *progress,
+                   guint                         n_values)
+{
+  const __m128d one = _mm_set1_pd (1.);
+  const __m128d two = _mm_set1_pd (2.);
+  const __m128i sinusoidal = _mm_set1_epi32 (AF_TIMELINE_PROGRESS_SINUSOIDAL);
+  const __m128i exponential = _mm_set1_epi32 (AF_TIMELINE_PROGRESS_EXPONENTIAL);
+  const __m128i ease_in_out = _mm_set1_epi32 (AF_TIMELINE_PROGRESS_EASE_IN_EASE_OUT);
+  guint i;
+
+  for (i = 0; i + 2 <= n_values; i += 2)
+    {
+      __m128d x, x2, sin, exp, in, out, inout, result;
+      __m128i types;
+
+      x = _mm_loadu_pd (&linear_progress[i]);
+
+      /* widen both 32 bit types to 64 bit lanes */
+      types = _mm_loadl_epi64 ((const __m128i *) &progress_types[i]);
+      types = _mm_unpacklo_epi32 (types, types);
+
+      x2 = _mm_mul_pd (x, x);
+      sin = _mm_add_pd (_mm_set1_pd (SIN_C9), _mm_mul_pd (x2, _mm_set1_pd (SIN_C11)));
+      sin = _mm_add_pd (_mm_set1_pd (SIN_C7), _mm_mul_pd (x2, sin));
+      sin = _mm_add_pd (_mm_set1_pd (SIN_C5), _mm_mul_pd (x2, sin));
+      sin = _mm_add_pd (_mm_set1_pd (SIN_C3), _mm_mul_pd (x2, sin));
+      sin = _mm_add_pd (_mm_set1_pd (SIN_C1), _mm_mul_pd (x2, sin));
+      sin = _mm_mul_pd (x, sin);
+
+      exp = x2;
+
+      in = _mm_mul_pd (x, two);
+      out = _mm_sub_pd (in, two);
+      inout = SSE2_SELECT (_mm_cmplt_pd (in, one),
+                           _mm_div_pd (_mm_mul_pd (_mm_mul_pd (in, in), in), two),
+                           _mm_div_pd (_mm_add_pd (_mm_mul_pd (_mm_mul_pd (out, out), out), two), two));
+
+      result = x;
+      result = SSE2_SELECT (_mm_castsi128_pd (_mm_cmpeq_epi32 (types, sinusoidal)), sin, result);
+      result = SSE2_SELECT (_mm_castsi128_pd (_mm_cmpeq_epi32 (types, exponential)), exp, result);
+      result = SSE2_SELECT (_mm_castsi128_pd (_mm_cmpeq_epi32 (types, ease_in_out)), inout, result);
+
+      _mm_storeu_pd (&progress[i], result);
+    }
+
+  easing_batch_scalar (&linear_progress[i], &progress_types[i],
+                       &progress[i], n_values - i);
+}
+
+#endif /* AF_HAVE_SSE2 */
+
+#ifdef AF_HAVE_AVX2
+
+__attribute__ ((target ("avx2")))
+static void
+easing_batch_avx2 (const gdouble                *linear_progress,
+                   const AfTimelineProgressType *progress_types,
+                   gdouble                      *progress,
+                   guint                         n_values)
+{
+  const __m256d one = _mm256_set1_pd (1.);
+  const __m256d two = _mm256_set1_pd (2.);
+  const __m256i sinusoidal = _mm256_set1_epi64x (AF_TIMELINE_PROGRESS_SINUSOIDAL);
+  const __m256i exponential = _mm256_set1_epi64x (AF_TIMELINE_PROGRESS_EXPONENTIAL);
+  const __m256i ease_in_out = _mm256_set1_epi64x (AF_TIMELINE_PROGRESS_EASE_IN_EASE_OUT);
+  guint i;
+
+  for (i = 0; i + 4 <= n_values; i += 4)
+    {
+      __m256d x, x2, sin, in, out, inout, result;
+      __m256i types;
+
+      x = _mm256_loadu_pd (&linear_progress[i]);
+      types = _mm256_cvtepi32_epi64 (_mm_loadu_si128 ((const __m128i *) &progress_types[i]));
+
+      /* no FMA, to match the scalar path bit by bit */
+      x2 = _mm256_mul_pd (x, x);
+      sin = _mm256_add_pd (_mm256_set1_pd (SIN_C9), _mm256_mul_pd (x2, _mm256_set1_pd (SIN_C11)));
+      sin = _mm256_add_pd (_mm256_set1_pd (SIN_C7), _mm256_mul_pd (x2, sin));
+      sin = _mm256_add_pd (_mm256_set1_pd (SIN_C5), _mm256_mul_pd (x2, sin));
+      sin = _mm256_add_pd (_mm256_set1_pd (SIN_C3), _mm256_mul_pd (x2, sin));
+      sin = _mm256_add_pd (_mm256_set1_pd (SIN_C1), _mm256_mul_pd (x2, sin));
+      sin = _mm256_mul_pd (x, sin);
+
+      in = _mm256_mul_pd (x, two);
+      out = _mm256_sub_pd (in, two);
+      inout = _mm256_blendv_pd (_mm256_div_pd (_mm256_add_pd (_mm256_mul_pd (_mm256_mul_pd (out, out), out), two), two),
+                                _mm256_div_pd (_mm256_mul_pd (_mm256_mul_pd (in, in), in), two),
+                                _mm256_cmp_pd (in, one, _CMP_LT_OQ));
+
+      result = x;
+      result = _mm256_blendv_pd (result, sin,
+                                 _mm256_castsi256_pd (_mm256_cmpeq_epi64 (types, sinusoidal)));
+      result = _mm256_blendv_pd (result, x2,
+                                 _mm256_castsi256_pd (_mm256_cmpeq_epi64 (types, exponential)));
+      result = _mm256_blendv_pd (result, inout,
+                                 _mm256_castsi256_pd (_mm256_cmpeq_epi64 (types, ease_in_out)));
+
+      _mm256_storeu_pd (&progress[i], result);
+    }
+
+  easing_batch_scalar (&linear_progress[i], &progress_types[i],
+                       &progress[i], n_values - i);
+}
+
+#endif /* AF_HAVE_AVX2 */
+
+typedef void (* AfEasingBatchFunc) (const gdouble                *linear_progress,
+                                    const AfTimelineProgressType *progress_types,
+                                    gdouble                      *progress,
+                                    guint                         n_values);
+
+static AfEasingBatchFunc
+easing_batch_pick (void)
+{
+  /* the vector kernels load types as 32 bit integers */
+  if (sizeof (AfTimelineProgressType) != sizeof (gint32))
+    return easing_batch_scalar;
+
+#ifdef AF_HAVE_AVX2
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    return easing_batch_avx2;
+#endif
+
+#ifdef AF_HAVE_SSE2
+  return easing_batch_sse2;
+#else
+  return easing_batch_scalar;
+#endif
+}
+
+/**
+ * af_timeline_calculate_progress_batch:
+ * @linear_progress: array of linear progress values
+ * @progress_types: array with the progress type of each value
+ * @progress: array to store the resulting progress values in
+ * @n_values: number of elements in the arrays
+ *
+ * Equivalent to calling af_timeline_calculate_progress() on
+ * each element, but using SIMD instructions where available.
+ * @progress may be the same array as @linear_progress.
+ **/
+void
+af_timeline_calculate_progress_batch (const gdouble                *linear_progress,
+                                      const AfTimelineProgressType *progress_types,
+                                      gdouble                      *progress,
+                                      guint                         n_values)
+{
+  static AfEasingBatchFunc batch_func = NULL;
+
+  if (n_values == 0)
+    return;
+
+  g_return_if_fail (linear_progress != NULL);
+  g_return_if_fail (progress_types != NULL);
+  g_return_if_fail (progress != NULL);
+
+  if (G_UNLIKELY (!batch_func))
+    batch_func = easing_batch_pick ();
+
+  (batch_func) (linear_progress, progress_types, progress, n_values);
+
+  /* registered curves came out as linear progress */
+  if (__atomic_load_n (&n_curves, __ATOMIC_ACQUIRE) > 0)
+    {
+      AfEasingCurve *curve;
+      guint i;
+
+      for (i = 0; i < n_values; i++)
+        {
+          if (G_LIKELY ((guint) progress_types[i] < CURVE_FIRST_ID))
+            continue;
+
+          curve = easing_curve_lookup (progress_types[i]);
+
+          if (curve)
+            progress[i] = easing_curve_evaluate (curve, progress[i]);
+        }
+    }
+}
+
+static AfTimelineProgressType
+easing_curve_register (const gchar   *key,
+                       AfEasingCurve *curve)
+{
+  AfEasingCurve **new_curves;
+  gpointer id;
+
+  G_LOCK (curves);
+
+  if (!curves_by_key)
+    curves_by_key = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
+
+  /* the same curve registered twice gets the same id */
+  if (key && g_hash_table_lookup_extended (curves_by_key, key, NULL, &id))
+    {
+      G_UNLOCK (curves);
+      g_free (curve);
+
+      return GPOINTER_TO_UINT (id);
+    }
+
+  if (n_curves == curves_size)
+    {
+      curves_size = MAX (16, curves_size * 2);
+      new_curves = g_new0 (AfEasingCurve *, curves_size);
+
+      if (curves)
+        memcpy (new_curves, curves, n_curves * sizeof (AfEasingCurve *));
+
+      g_atomic_pointer_set ((gpointer *) &curves, new_curves);
+    }
+
+  curves[n_curves] = curve;
+  id = GUINT_TO_POINTER (CURVE_FIRST_ID + n_curves);
+
+  if (key)
+    g_hash_table_insert (curves_by_key, g_strdup (key), id);
+
+  __atomic_store_n (&n_curves, n_curves + 1, __ATOMIC_RELEASE);
+
+  G_UNLOCK (curves);
+
+  return GPOINTER_TO_UINT (id);
+}
+
+static inline gdouble
+bezier_coordinate (gdouble t,
+                   gdouble p1,
+                   gdouble p2)
+{
+  gdouble u = 1 - t;
+
+  return 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t;
+}
+
+static inline gdouble
+bezier_slope (gdouble t,
+              gdouble p1,
+              gdouble p2)
+{
+  gdouble u = 1 - t;
+
+  return 3 * u * u * p1 + 6 * u * t * (p2 - p1) + 3 * t * t * (1 - p2);
+}
+
+/* parameter t at which the curve is at @x */
+static gdouble
+bezier_solve (gdouble x,
+              gdouble x1,
+              gdouble x2)
+{
+  gdouble t, low, high, error, slope;
+  guint i;
+
+  t = x;
+
+  for (i = 0; i < 8; i++)
+    {
+      error = bezier_coordinate (t, x1, x2) - x;
+
+      if (fabs (error) < 1e-12)
+        return t;
+
+      slope = bezier_slope (t, x1, x2);
+
+      if (fabs (slope) < 1e-6)
+        break;
+
+      t -= error / slope;
+
+      if (t < 0 || t > 1)
+        break;
+    }
+
+  /* x(t) is monotonic, bisection always gets there */
+  low = 0;
+  high = 1;
+  t = x;
+
+  for (i = 0; i < 64; i++)
+    {
+      error = bezier_coordinate (t, x1, x2) - x;
+
+      if (fabs (error) < 1e-12)
+        break;
+
+      if (error > 0)
+        high = t;
+      else
+        low = t;
+
+      t = (low + high) / 2;
+    }
+
+  return t;
+}
+
+/**
+ * af_timeline_register_cubic_bezier:
+ * @x1: x coordinate of the first control point, in [0, 1]
+ * @y1: y coordinate of the first control point
+ * @x2: x coordinate of the second control point, in [0, 1]
+ * @y2: y coordinate of the second control point
+ *
+ * Registers a progress type following the cubic bezier curve
+ * from (0, 0) to (1, 1) with the given control points, as in
+ * CSS cubic-bezier(). The curve is sampled once into a lookup
+ * table. Registering the same curve again returns the same type.
+ *
+ * Return value: the new progress type, usable anywhere a
+ * #AfTimelineProgressType is expected.
+ **/
+AfTimelineProgressType
+af_timeline_register_cubic_bezier (gdouble x1,
+                                   gdouble y1,
+                                   gdouble x2,
+                                   gdouble y2)
+{
+  AfEasingCurve *curve;
+  gchar *key;
+  AfTimelineProgressType type;
+  guint i;
+
+  g_return_val_if_fail (x1 >= 0. && x1 <= 1., AF_TIMELINE_PROGRESS_LINEAR);
+  g_return_val_if_fail (x2 >= 0. && x2 <= 1., AF_TIMELINE_PROGRESS_LINEAR);
+
+  curve = g_new0 (AfEasingCurve, 1);
+
+  for (i = 0; i <= CURVE_TABLE_SIZE; i++)
+    {
+      gdouble t;
+
+      t = bezier_solve ((gdouble) i / CURVE_TABLE_SIZE, x1, x2);
+      curve->table[i] = bezier_coordinate (t, y1, y2);
+    }
+
+  curve->table[0] = 0.;
+  curve->table[CURVE_TABLE_SIZE] = 1.;
+
+  key = g_strdup_printf ("cubic-bezier(%.17g,%.17g,%.17g,%.17g)", x1, y1, x2, y2);
+  type = easing_curve_register (key, curve);
+  g_free (key);
+
+  return type;
+}
+
+/**
+ * af_timeline_register_steps:
+ * @n_steps: number of steps, at least 1
+ * @jump_start: whether the first jump happens at the start
+ *
+ * Registers a progress type that moves in @n_steps equal jumps,
+ * as CSS steps() with jump-start or jump-end.
+ *
+ * Return value: the new progress type
+ **/
+AfTimelineProgressType
+af_timeline_register_steps (guint    n_steps,
+                            gboolean jump_start)
+{
+  AfEasingCurve *curve;
+  gchar *key;
+  AfTimelineProgressType type;
+
+  g_return_val_if_fail (n_steps > 0, AF_TIMELINE_PROGRESS_LINEAR);
+
+  curve = g_new0 (AfEasingCurve, 1);
+  curve->n_steps = n_steps;
+  curve->jump_start = (jump_start != FALSE);
+
+  key = g_strdup_printf ("steps(%u,%d)", n_steps, curve->jump_start);
+  type = easing_curve_register (key, curve);
+  g_free (key);
+
+  return type;
+}
+
+/**
+ * af_timeline_register_progress_func:
+ * @func: function mapping linear progress to eased progress
+ * @user_data: data to pass to @func
+ *
+ * Registers a progress type following an arbitrary curve. @func
+ * is only called from this function, to fill the lookup table,
+ * so it should be continuous for the result to be accurate.
+ *
+ * Return value: the new progress type
+ **/
+AfTimelineProgressType
+af_timeline_register_progress_func (AfTimelineProgressFunc func,
+                                    gpointer               user_data)
+{
+  AfEasingCurve *curve;
+  guint i;
+
+  g_return_val_if_fail (func != NULL, AF_TIMELINE_PROGRESS_LINEAR);
+
+  curve = g_new0 (AfEasingCurve, 1);
+
+  for (i = 0; i <= CURVE_TABLE_SIZE; i++)
+    curve->table[i] = (func) ((gdouble) i / CURVE_TABLE_SIZE, user_data);
+
+  return easing_curve_register (NULL, curve);
+}
@@ -35,6 +35,18 @@ typedef enum {
   AF_TIMELINE_PROGRESS_EASE_IN_EASE_OUT
 } AfTimelineProgressType;
 
+typedef enum {
+  AF_ANIMATOR_COMMAND_START,
+  AF_ANIMATOR_COMMAND_PAUSE,
+  AF_ANIMATOR_COMMAND_RESUME,
+  AF_ANIMATOR_COMMAND_RESUME_WITH_PROGRESS,
+  AF_ANIMATOR_COMMAND_REVERSE,
+  AF_ANIMATOR_COMMAND_ADVANCE,
+  AF_ANIMATOR_COMMAND_SET_LOOP,
+  AF_ANIMATOR_COMMAND_REMOVE,
+  AF_ANIMATOR_COMMAND_RETARGET
+} AfAnimatorCommand;
+
 
 G_END_DECLS
 
@@ -37,6 +37,28 @@ af_timeline_progress_type_get_type(void) {
 	
 	return etype;
 }
+GType
+af_animator_command_get_type(void) {
+	static GType etype = 0;
+	if(!etype) {
+		static const GEnumValue values[] = {
+			{AF_ANIMATOR_COMMAND_START, "AF_ANIMATOR_COMMAND_START", "start"},
+			{AF_ANIMATOR_COMMAND_PAUSE, "AF_ANIMATOR_COMMAND_PAUSE", "pause"},
+			{AF_ANIMATOR_COMMAND_RESUME, "AF_ANIMATOR_COMMAND_RESUME", "resume"},
+			{AF_ANIMATOR_COMMAND_RESUME_WITH_PROGRESS, "AF_ANIMATOR_COMMAND_RESUME_WITH_PROGRESS", "resume-with-progress"},
+			{AF_ANIMATOR_COMMAND_REVERSE, "AF_ANIMATOR_COMMAND_REVERSE", "reverse"},
+			{AF_ANIMATOR_COMMAND_ADVANCE, "AF_ANIMATOR_COMMAND_ADVANCE", "advance"},
+			{AF_ANIMATOR_COMMAND_SET_LOOP, "AF_ANIMATOR_COMMAND_SET_LOOP", "set-loop"},
+			{AF_ANIMATOR_COMMAND_REMOVE, "AF_ANIMATOR_COMMAND_REMOVE", "remove"},
+			{AF_ANIMATOR_COMMAND_RETARGET, "AF_ANIMATOR_COMMAND_RETARGET", "retarget"},
+			{0, NULL, NULL}
+		};
+
+		etype = g_enum_register_static("AfAnimatorCommand", values);
+	}
+	
+	return etype;
+}
 
 /* Generated data ends here */
 
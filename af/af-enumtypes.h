@@ -14,6 +14,8 @@ GType af_timeline_direction_get_type (void);
 #define AF_TYPE_TIMELINE_DIRECTION (af_timeline_direction_get_type())
 GType af_timeline_progress_type_get_type (void);
 #define AF_TYPE_TIMELINE_PROGRESS_TYPE (af_timeline_progress_type_get_type())
+GType af_animator_command_get_type (void);
+#define AF_TYPE_ANIMATOR_COMMAND (af_animator_command_get_type())
 G_END_DECLS
 
 #endif /* !GIGGLE_ENUMERATIONS_H */
@@ -0,0 +1,218 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* af-master-clock.c
+ *
+ * Copyright (C) 2007 Carlos Garnacho <carlos@imendio.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* The master clock is the default AfClock and owns the only
+ * real-time frame source in the process. Every tick advances
+ * all of its running timelines in one pass, so the number of
+ * wakeups does not depend on the number of live animations.
+ *
+ * Ticks are scheduled against absolute deadlines on the
+ * monotonic clock, base_time + n * interval, so the frame
+ * interval never accumulates rounding errors.
+ */
+
+#include <gtk/gtk.h>
+#include <glib-object.h>
+#include <math.h>
+#include "af-clock.h"
+#include "af-private.h"
+
+#define AF_MASTER_CLOCK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), _af_master_clock_get_type (), AfMasterClock))
+
+typedef struct AfMasterClock AfMasterClock;
+typedef struct AfMasterClockClass AfMasterClockClass;
+typedef struct AfClockSource AfClockSource;
+
+struct AfMasterClock
+{
+  AfClock parent_instance;
+
+  GSource *source;
+  guint fps;
+
+  /* frame n is due at base_time + n * interval */
+  gint64 base_time;
+  gdouble interval;
+  guint64 frame;
+};
+
+struct AfMasterClockClass
+{
+  AfClockClass parent_class;
+};
+
+struct AfClockSource
+{
+  GSource source;
+  AfMasterClock *clock;
+};
+
+static gint64 af_master_clock_get_time (AfClock *clock);
+static void   af_master_clock_schedule (AfClock *clock);
+
+
+G_DEFINE_TYPE (AfMasterClock, _af_master_clock, AF_TYPE_CLOCK)
+
+
+static gint64
+master_clock_get_deadline (AfMasterClock *clock)
+{
+  return clock->base_time + (gint64) (clock->frame * clock->interval);
+}
+
+static gboolean
+clock_source_prepare (GSource *source,
+                      gint    *timeout)
+{
+  AfMasterClock *clock;
+  gint64 now, deadline;
+
+  clock = ((AfClockSource *) source)->clock;
+  now = g_source_get_time (source);
+  deadline = master_clock_get_deadline (clock);
+
+  if (now >= deadline)
+    {
+      *timeout = 0;
+      return TRUE;
+    }
+
+  /* round up, waking up early would just spin */
+  *timeout = (gint) ((deadline - now + 999) / 1000);
+
+  return FALSE;
+}
+
+static gboolean
+clock_source_check (GSource *source)
+{
+  AfMasterClock *clock;
+
+  clock = ((AfClockSource *) source)->clock;
+
+  return (g_source_get_time (source) >= master_clock_get_deadline (clock));
+}
+
+static gboolean
+clock_source_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+  gboolean retval;
+
+  gdk_threads_enter ();
+  retval = (callback) (user_data);
+  gdk_threads_leave ();
+
+  return retval;
+}
+
+static GSourceFuncs clock_source_funcs = {
+  clock_source_prepare,
+  clock_source_check,
+  clock_source_dispatch,
+  NULL
+};
+
+static void
+_af_master_clock_class_init (AfMasterClockClass *class)
+{
+  AfClockClass *clock_class = AF_CLOCK_CLASS (class);
+
+  clock_class->get_time = af_master_clock_get_time;
+  clock_class->schedule = af_master_clock_schedule;
+}
+
+static void
+_af_master_clock_init (AfMasterClock *clock)
+{
+}
+
+static gint64
+af_master_clock_get_time (AfClock *clock)
+{
+  return g_get_monotonic_time ();
+}
+
+static void
+master_clock_stop (AfMasterClock *clock)
+{
+  if (!clock->source)
+    return;
+
+  g_source_destroy (clock->source);
+  g_source_unref (clock->source);
+  clock->source = NULL;
+  clock->fps = 0;
+}
+
+static gboolean
+master_clock_tick (gpointer user_data)
+{
+  AfMasterClock *clock;
+  gint64 now;
+
+  clock = AF_MASTER_CLOCK (user_data);
+  now = g_source_get_time (clock->source);
+
+  /* Schedule the next deadline. If we fell behind
+   * by more than a frame, skip the missed ones
+   * instead of trying to catch up.
+   */
+  clock->frame++;
+
+  if (master_clock_get_deadline (clock) <= now)
+    clock->frame = (guint64) floor ((now - clock->base_time) / clock->interval) + 1;
+
+  af_clock_dispatch (AF_CLOCK (clock), now);
+
+  /* the source is destroyed by now if not needed */
+  return TRUE;
+}
+
+static void
+af_master_clock_schedule (AfClock *clock)
+{
+  AfMasterClock *master_clock;
+  guint fps;
+
+  master_clock = AF_MASTER_CLOCK (clock);
+  fps = af_clock_get_fps (clock);
+
+  if (master_clock->source && fps == master_clock->fps)
+    return;
+
+  master_clock_stop (master_clock);
+
+  if (fps == 0)
+    return;
+
+  master_clock->fps = fps;
+  master_clock->interval = (gdouble) G_USEC_PER_SEC / fps;
+  master_clock->frame = 1;
+  master_clock->base_time = g_get_monotonic_time ();
+
+  master_clock->source = g_source_new (&clock_source_funcs, sizeof (AfClockSource));
+  ((AfClockSource *) master_clock->source)->clock = master_clock;
+
+  g_source_set_callback (master_clock->source, master_clock_tick, master_clock, NULL);
+  g_source_attach (master_clock->source, NULL);
+}
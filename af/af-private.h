@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2007 Carlos Garnacho <carlos@imendio.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AF_PRIVATE_H__
+#define __AF_PRIVATE_H__
+
+#include <glib-object.h>
+#include "af-clock.h"
+#include "af-timeline.h"
+
+G_BEGIN_DECLS
+
+/* af-animator.c */
+void      _af_animator_run_commands        (void);
+void      _af_animator_run_commit          (void);
+
+/* af-clock.c */
+void      _af_clock_add_timeline           (AfClock    *clock,
+                                            AfTimeline *timeline);
+void      _af_clock_remove_timeline        (AfClock    *clock,
+                                            AfTimeline *timeline);
+void      _af_clock_update                 (AfClock    *clock);
+
+/* af-easing.c */
+gdouble   _af_easing_calculate             (gdouble                linear_progress,
+                                            AfTimelineProgressType progress_type);
+
+/* af-master-clock.c */
+GType     _af_master_clock_get_type        (void) G_GNUC_CONST;
+
+/* af-timeline.c */
+gboolean  _af_timeline_run_frame           (AfTimeline *timeline,
+                                            gint64      frame_time);
+
+G_END_DECLS
+
+#endif /* __AF_PRIVATE_H__ */
@@ -21,43 +21,111 @@
 
 #include <gtk/gtk.h>
 #include <glib-object.h>
-#include <math.h>
+#include <string.h>
 #include "af-timeline.h"
+#include "af-private.h"
 
 #define AF_TIMELINE_GET_PRIV(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), AF_TYPE_TIMELINE, AfTimelinePriv))
-#define MSECS_PER_SEC 1000
-#define FRAME_INTERVAL(nframes) (MSECS_PER_SEC / nframes)
 #define DEFAULT_FPS 30
 
+/* smallest histogram bucket limit, as a power of 2 */
+#define STATS_BUCKET_SHIFT 8
+
+/* Timeline state word layout: flags and the timing epoch in
+ * the low bits, and a signed payload above them. While running
+ * with a non-zero duration (STATE_TIMED) the payload is the
+ * clock time at which progress is 0, in 1/16 microsecond
+ * units. Otherwise it is the progress itself as fixed point.
+ */
+#define STATE_RUNNING        (1 << 0)
+#define STATE_BACKWARD       (1 << 1)
+#define STATE_TIMED          (1 << 2)
+#define STATE_EPOCH_SHIFT    3
+#define STATE_EPOCH_MAX      0xf
+#define STATE_EPOCH_MASK     (STATE_EPOCH_MAX << STATE_EPOCH_SHIFT)
+#define STATE_FLAGS_BITS     7
+
+#define STATE_EPOCH(state)   (((state) & STATE_EPOCH_MASK) >> STATE_EPOCH_SHIFT)
+
+#define STATE_TIME_SCALE     16
+#define STATE_PROGRESS_SCALE ((gdouble) (G_GINT64_CONSTANT (1) << 46))
+#define STATE_PROGRESS_MAX   256.
+#define STATE_PAYLOAD_MAX    ((gdouble) (G_GINT64_CONSTANT (1) << 55))
+
 typedef struct AfTimelinePriv AfTimelinePriv;
 typedef struct AfMarker AfMarker;
+typedef struct AfFrameFunc AfFrameFunc;
 
 struct AfTimelinePriv
 {
   guint duration;
   guint fps;
-  guint source_id;
-
-  GTimer *timer;
 
   GdkScreen *screen;
+  AfClock *clock;
 
   guint animations_enabled : 1;
   guint loop               : 1;
-  guint direction          : 1;
-
-  gdouble last_progress;
-
-  GList *marker_list;
-  GList *marker_position;
+  guint started            : 1;
+  guint marker_names_stale : 1;
+  guint in_frame_funcs     : 1;
+
+  /* Progress, direction and running flag packed in a
+   * single word, so other threads can read or replace
+   * them atomically. See state_encode().
+   */
+  volatile guint64 state;
+
+  /* The state word is relative to the duration and clock,
+   * those are replaced under this bit lock along with the
+   * epoch the state word is encoded with.
+   */
+  volatile gint timing_lock;
+  guint epoch;
+
+  /* Markers sorted by progress, with interned names. The
+   * name table maps to positions in the array, those get
+   * shifted in place by single insertions and removals, and
+   * rebuilt lazily after batch additions.
+   */
+  GArray *markers;
+  GHashTable *marker_names;
+
+  /* next marker to be crossed in the current direction,
+   * -1 or markers->len once past either end.
+   */
+  gint marker_position;
+
+  /* names crossed so far in this frame, for "markers" */
+  GPtrArray *crossed_markers;
+
+  /* Called directly on every frame, before "frame" is
+   * emitted. Entries removed while calling them are only
+   * cleared, and compacted once the calls are done.
+   */
+  GArray *frame_funcs;
+  guint frame_func_id;
+  guint n_removed_frame_funcs;
+
+  /* NULL unless collecting statistics, the last
+   * frame time is -1 until a frame is recorded.
+   */
+  AfTimelineStats *stats;
+  gint64 stats_last_frame;
+};
 
-  GStaticMutex progress_mutex;
+struct AfFrameFunc
+{
+  AfTimelineFrameFunc func;
+  gpointer data;
+  GDestroyNotify destroy;
+  guint id;
 };
 
 struct AfMarker
 {
   gdouble progress;
-  gchar *name;
+  GQuark name;
 };
 
 /* Marker helper functions - START */
@@ -68,24 +136,45 @@ static void marker_emit_signals (AfTimeline *timeline,
 static void marker_skip_progress (AfTimeline *timeline,
 		                  gdouble     progress);
 
-static gint marker_compare_progress (gconstpointer a,
-		                     gconstpointer b);
+static guint marker_lower_bound (AfTimelinePriv *priv,
+                                 gdouble         progress);
 
-/*
-static gint marker_compare_name_with_progress (gconstpointer a,
-		                               gconstpointer b);
+static guint marker_upper_bound (AfTimelinePriv *priv,
+                                 gdouble         progress);
 
-static gint marker_compare_name (gconstpointer a,
-		                 gconstpointer b);
-*/
+static gint marker_lookup (AfTimelinePriv *priv,
+                           const gchar    *marker_name);
 
-static gint marker_compare_name_with_string (gconstpointer a,
-		                             gconstpointer b);
+static void marker_reset_position (AfTimelinePriv *priv);
 
-static void marker_free (gpointer data,
-		         gpointer user_data);
+static void marker_emit_crossed (AfTimeline *timeline);
 /* END */
 
+static guint64             state_encode          (guint64         flags,
+                                                  gdouble         progress,
+                                                  guint           duration,
+                                                  gint64          now);
+static gdouble             state_progress_at     (guint64         state,
+                                                  guint           duration,
+                                                  gint64          now);
+static gboolean            timeline_is_running   (AfTimelinePriv *priv);
+static AfTimelineDirection timeline_direction    (AfTimelinePriv *priv);
+static gdouble             timeline_progress_at  (AfTimelinePriv *priv,
+                                                  gint64          now);
+static void                timeline_set_timing   (AfTimelinePriv *priv,
+                                                  guint           duration,
+                                                  AfClock        *clock);
+static guint64             timeline_snapshot     (AfTimelinePriv *priv,
+                                                  guint          *duration,
+                                                  gint64         *now);
+static void                timeline_update_state (AfTimelinePriv *priv,
+                                                  gint64          now,
+                                                  guint           set_flags,
+                                                  guint           clear_flags,
+                                                  const gdouble  *progress);
+static void                timeline_wrap         (AfTimelinePriv *priv,
+                                                  gint64          now);
+
 enum {
   PROP_0,
   PROP_FPS,
@@ -93,7 +182,9 @@ enum {
   PROP_DELAY,
   PROP_LOOP,
   PROP_DIRECTION,
-  PROP_SCREEN
+  PROP_SCREEN,
+  PROP_CLOCK,
+  PROP_COLLECT_STATS
 };
 
 enum {
@@ -102,11 +193,15 @@ enum {
   FINISHED,
   FRAME,
   MARKER,
+  MARKERS,
   LAST_SIGNAL
 };
 
 static guint signals [LAST_SIGNAL] = { 0, };
 
+static AfTimelineStats global_stats = { 0, };
+static gboolean collect_stats_default = FALSE;
+
 
 static void  af_timeline_set_property  (GObject         *object,
                                         guint            prop_id,
@@ -171,6 +266,20 @@ af_timeline_class_init (AfTimelineClass *class)
 							"Screen to get the settings from",
 							GDK_TYPE_SCREEN,
 							G_PARAM_READWRITE));
+  g_object_class_install_property (object_class,
+				   PROP_CLOCK,
+				   g_param_spec_object ("clock",
+							"Clock",
+							"Clock that drives the timeline",
+							AF_TYPE_CLOCK,
+							G_PARAM_READWRITE));
+  g_object_class_install_property (object_class,
+				   PROP_COLLECT_STATS,
+				   g_param_spec_boolean ("collect-stats",
+							 "Collect stats",
+							 "Whether to collect frame timing statistics",
+							 FALSE,
+							 G_PARAM_READWRITE));
 
   signals[STARTED] =
     g_signal_new ("started",
@@ -209,17 +318,33 @@ af_timeline_class_init (AfTimelineClass *class)
 		  G_TYPE_NONE, 1,
 		  G_TYPE_DOUBLE);
 
+  /* The marker name is also the signal detail, so handlers
+   * can connect to "marker::name" for a single marker.
+   */
   signals[MARKER] =
     g_signal_new ("marker",
 		  G_TYPE_FROM_CLASS (object_class),
-		  G_SIGNAL_RUN_LAST,
+		  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
 		  G_STRUCT_OFFSET (AfTimelineClass, marker),
 		  NULL, NULL,
 		  g_cclosure_marshal_VOID__STRING,
 		  G_TYPE_NONE, 1,
-		  G_TYPE_STRING);
+		  G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+
+  signals[MARKERS] =
+    g_signal_new ("markers",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_LAST,
+		  G_STRUCT_OFFSET (AfTimelineClass, markers),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__BOXED,
+		  G_TYPE_NONE, 1,
+		  G_TYPE_STRV | G_SIGNAL_TYPE_STATIC_SCOPE);
 
   g_type_class_add_private (class, sizeof (AfTimelinePriv));
+
+  /* lets production builds watch for jank without code changes */
+  collect_stats_default = (g_getenv ("AF_TIMELINE_STATS") != NULL);
 }
 
 static void
@@ -231,15 +356,23 @@ af_timeline_init (AfTimeline *timeline)
 
   priv->fps = DEFAULT_FPS;
   priv->duration = 0.0;
-  priv->direction = AF_TIMELINE_DIRECTION_FORWARD;
   priv->screen = gdk_screen_get_default ();
+  priv->clock = g_object_ref (af_clock_get_default ());
 
-  priv->last_progress = 0;
+  /* forward, stopped at 0, first epoch */
+  priv->state = 0;
+  priv->timing_lock = 0;
+  priv->epoch = 0;
 
-  priv->marker_list = NULL;
-  priv->marker_position = NULL;
+  priv->markers = g_array_new (FALSE, FALSE, sizeof (AfMarker));
+  priv->marker_names = g_hash_table_new (NULL, NULL);
+  priv->crossed_markers = g_ptr_array_new ();
+  priv->frame_funcs = g_array_new (FALSE, FALSE, sizeof (AfFrameFunc));
 
-  g_static_mutex_init (&priv->progress_mutex);
+  priv->stats_last_frame = -1;
+
+  if (collect_stats_default)
+    priv->stats = g_slice_new0 (AfTimelineStats);
 }
 
 static void
@@ -272,6 +405,13 @@ af_timeline_set_property (GObject      *object,
       af_timeline_set_screen (timeline,
                               GDK_SCREEN (g_value_get_object (value)));
       break;
+    case PROP_CLOCK:
+      af_timeline_set_clock (timeline,
+                             AF_CLOCK (g_value_get_object (value)));
+      break;
+    case PROP_COLLECT_STATS:
+      af_timeline_set_collect_stats (timeline, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -301,11 +441,17 @@ af_timeline_get_property (GObject    *object,
       g_value_set_boolean (value, priv->loop);
       break;
     case PROP_DIRECTION:
-      g_value_set_enum (value, priv->direction);
+      g_value_set_enum (value, timeline_direction (priv));
       break;
     case PROP_SCREEN:
       g_value_set_object (value, priv->screen);
       break;
+    case PROP_CLOCK:
+      g_value_set_object (value, priv->clock);
+      break;
+    case PROP_COLLECT_STATS:
+      g_value_set_boolean (value, priv->stats != NULL);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -315,102 +461,221 @@ static void
 af_timeline_finalize (GObject *object)
 {
   AfTimelinePriv *priv;
+  guint i;
 
   priv = AF_TIMELINE_GET_PRIV (object);
 
-  if (priv->source_id)
+  if (timeline_is_running (priv))
+    _af_clock_remove_timeline (priv->clock, AF_TIMELINE (object));
+
+  g_object_unref (priv->clock);
+
+  g_array_free (priv->markers, TRUE);
+  g_hash_table_destroy (priv->marker_names);
+  g_ptr_array_free (priv->crossed_markers, TRUE);
+
+  for (i = 0; i < priv->frame_funcs->len; i++)
     {
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
+      AfFrameFunc *frame_func;
+
+      frame_func = &g_array_index (priv->frame_funcs, AfFrameFunc, i);
+
+      if (frame_func->destroy)
+        (frame_func->destroy) (frame_func->data);
     }
 
-  if (priv->timer)
-    g_timer_destroy (priv->timer);
+  g_array_free (priv->frame_funcs, TRUE);
+
+  if (priv->stats)
+    g_slice_free (AfTimelineStats, priv->stats);
+
+  G_OBJECT_CLASS (af_timeline_parent_class)->finalize (object);
+}
+
+static guint
+stats_bucket (gint64 usecs)
+{
+  guint bucket = 0;
+
+  usecs >>= STATS_BUCKET_SHIFT;
 
-  if (priv->marker_list)
+  while (usecs > 0 && bucket < AF_TIMELINE_STATS_N_BUCKETS - 1)
     {
-      g_list_foreach (priv->marker_list, &marker_free, NULL);
-      g_list_free (priv->marker_list);
+      usecs >>= 1;
+      bucket++;
     }
-  g_list_free (priv->marker_position);
 
-  g_static_mutex_free (&priv->progress_mutex);
+  return bucket;
+}
 
-  G_OBJECT_CLASS (af_timeline_parent_class)->finalize (object);
+static void
+stats_add_frame (AfTimelineStats *stats,
+                 gint64           interval,
+                 gint64           expected_interval,
+                 gint64           handler_time)
+{
+  stats->n_frames++;
+  stats->handler_histogram[stats_bucket (handler_time)]++;
+  stats->worst_handler_time = MAX (stats->worst_handler_time, handler_time);
+
+  /* the first frame after starting has no interval */
+  if (interval < 0)
+    return;
+
+  stats->interval_histogram[stats_bucket (interval)]++;
+  stats->worst_interval = MAX (stats->worst_interval, interval);
+
+  /* late if over a quarter of an interval past the deadline */
+  if (interval * 4 > expected_interval * 5)
+    stats->n_late_frames++;
+
+  if (interval >= expected_interval * 2)
+    stats->n_skipped_intervals += (interval + expected_interval / 2) / expected_interval - 1;
 }
 
-static gboolean
-af_timeline_run_frame (AfTimeline *timeline)
+static void
+timeline_stats_add_frame (AfTimelinePriv *priv,
+                          gint64          frame_time,
+                          gint64          handler_time)
+{
+  gint64 interval, expected_interval;
+
+  interval = (priv->stats_last_frame >= 0) ? frame_time - priv->stats_last_frame : -1;
+
+  /* rates over a frame per microsecond are not told apart */
+  expected_interval = MAX (G_USEC_PER_SEC / priv->fps, 1);
+  priv->stats_last_frame = frame_time;
+
+  stats_add_frame (priv->stats, interval, expected_interval, handler_time);
+  stats_add_frame (&global_stats, interval, expected_interval, handler_time);
+}
+
+/* Drops the entries removed while the funcs were being called,
+ * destroy notifiers may add or remove funcs themselves.
+ */
+static void
+frame_funcs_compact (AfTimelinePriv *priv)
+{
+  guint i = 0;
+
+  while (priv->n_removed_frame_funcs > 0 && i < priv->frame_funcs->len)
+    {
+      AfFrameFunc frame_func;
+
+      frame_func = g_array_index (priv->frame_funcs, AfFrameFunc, i);
+
+      if (frame_func.func)
+        {
+          i++;
+          continue;
+        }
+
+      g_array_remove_index (priv->frame_funcs, i);
+      priv->n_removed_frame_funcs--;
+
+      if (frame_func.destroy)
+        (frame_func.destroy) (frame_func.data);
+    }
+}
+
+static void
+timeline_emit_frame (AfTimeline *timeline,
+                     gdouble     progress)
 {
   AfTimelinePriv *priv;
-  gdouble delta_progress, progress;
-  guint elapsed_time;
+  guint i, n_funcs;
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  elapsed_time = (guint) (g_timer_elapsed (priv->timer, NULL) * 1000);
-  g_timer_start (priv->timer);
+  /* funcs added meanwhile wait for the next frame */
+  n_funcs = priv->frame_funcs->len;
 
-  if (priv->animations_enabled)
+  if (n_funcs > 0)
     {
-      delta_progress = (gdouble) elapsed_time / priv->duration;
+      gboolean nested;
 
-      /* enter critical section */
-      g_static_mutex_lock (&priv->progress_mutex);
-      progress = priv->last_progress;
+      nested = priv->in_frame_funcs;
+      priv->in_frame_funcs = TRUE;
 
-      if (priv->direction == AF_TIMELINE_DIRECTION_BACKWARD)
-	progress -= delta_progress;
-      else
-	progress += delta_progress;
+      for (i = 0; i < n_funcs; i++)
+        {
+          AfFrameFunc *frame_func;
+
+          frame_func = &g_array_index (priv->frame_funcs, AfFrameFunc, i);
+
+          if (frame_func->func)
+            (frame_func->func) (timeline, progress, frame_func->data);
+        }
+
+      priv->in_frame_funcs = nested;
 
-      priv->last_progress = progress;
-      g_static_mutex_unlock (&priv->progress_mutex);
-      /* leave critical section */
+      if (!nested && priv->n_removed_frame_funcs > 0)
+        frame_funcs_compact (priv);
+    }
+
+  /* the signal is still there for everyone else */
+  if (AF_TIMELINE_GET_CLASS (timeline)->frame ||
+      g_signal_has_handler_pending (timeline, signals [FRAME], 0, FALSE))
+    g_signal_emit (timeline, signals [FRAME], 0, progress);
+}
+
+gboolean
+_af_timeline_run_frame (AfTimeline *timeline,
+                        gint64      frame_time)
+{
+  AfTimelinePriv *priv;
+  AfTimelineDirection direction;
+  gdouble progress;
 
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (priv->animations_enabled)
+    {
+      progress = timeline_progress_at (priv, frame_time);
       progress = CLAMP (progress, 0., 1.);
     }
   else
-    progress = (priv->direction == AF_TIMELINE_DIRECTION_FORWARD) ? 1.0 : 0.0;
+    progress = (timeline_direction (priv) == AF_TIMELINE_DIRECTION_FORWARD) ? 1.0 : 0.0;
 
   marker_emit_signals (timeline, progress, FALSE);
 
-  g_signal_emit (timeline, signals [FRAME], 0, progress);
+  if (G_UNLIKELY (priv->stats))
+    {
+      gint64 handler_start;
+
+      handler_start = g_get_monotonic_time ();
+      timeline_emit_frame (timeline, progress);
+
+      /* handlers may have turned statistics off */
+      if (priv->stats)
+        timeline_stats_add_frame (priv, frame_time,
+                                  g_get_monotonic_time () - handler_start);
+    }
+  else
+    timeline_emit_frame (timeline, progress);
 
   marker_emit_signals (timeline, progress, TRUE);
+  marker_emit_crossed (timeline);
+
+  direction = timeline_direction (priv);
 
-  if ((priv->direction == AF_TIMELINE_DIRECTION_FORWARD && progress >= 1.0) ||
-      (priv->direction == AF_TIMELINE_DIRECTION_BACKWARD && progress <= 0.0))
+  if ((direction == AF_TIMELINE_DIRECTION_FORWARD && progress >= 1.0) ||
+      (direction == AF_TIMELINE_DIRECTION_BACKWARD && progress <= 0.0))
     {
       if (!priv->loop)
 	{
-	  if (priv->source_id)
+	  if (timeline_is_running (priv))
 	    {
-	      g_source_remove (priv->source_id);
-	      priv->source_id = 0;
+	      timeline_update_state (priv, frame_time, 0, STATE_RUNNING, NULL);
+	      _af_clock_remove_timeline (priv->clock, timeline);
 	    }
-          g_timer_stop (priv->timer);
 	  g_signal_emit (timeline, signals [FINISHED], 0);
 	  return FALSE;
 	}
-      else
+      else if (timeline_is_running (priv))
         {
-          /* reset timer */
-          if (priv->timer)
-            {
-              if (af_timeline_get_direction(timeline) != AF_TIMELINE_DIRECTION_FORWARD)
-	        {
-      	          priv->last_progress = 1.0 + progress;
-
-		  priv->marker_position = g_list_last (priv->marker_list);
-		}
-              else
-	        {
-	          priv->last_progress = progress - 1.0;
-		  
-		  priv->marker_position = priv->marker_list;
-		}
-	    }
+          timeline_wrap (priv, frame_time);
+          marker_reset_position (priv);
 	}
     }
 
@@ -460,21 +725,23 @@ af_timeline_start (AfTimeline *timeline)
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  if (!priv->source_id)
+  if (!timeline_is_running (priv))
     {
-      if (priv->timer)
-        g_timer_continue (priv->timer);
-      else
+      if (!priv->started)
         {
-          priv->timer = g_timer_new ();
-
-          priv->marker_position = priv->marker_list;
+          priv->started = TRUE;
+          marker_reset_position (priv);
         }
 
       /* sanity check */
       g_assert (priv->fps > 0);
 
-      if (priv->screen)
+      /* Clocks other than the default one are driven
+       * explicitly, the desktop setting does not apply.
+       */
+      if (priv->clock != af_clock_get_default ())
+        enable_animations = TRUE;
+      else if (priv->screen)
         {
           settings = gtk_settings_get_for_screen (priv->screen);
           g_object_get (settings, "gtk-enable-animations", &enable_animations, NULL);
@@ -485,14 +752,15 @@ af_timeline_start (AfTimeline *timeline)
       g_signal_emit (timeline, signals [STARTED], 0);
     
       marker_emit_signals (timeline, 0, TRUE);
-
-      if (enable_animations)
-        priv->source_id = gdk_threads_add_timeout (FRAME_INTERVAL (priv->fps),
-                                                   (GSourceFunc) af_timeline_run_frame,
-                                                 timeline);
-      else
-        priv->source_id = gdk_threads_add_idle ((GSourceFunc) af_timeline_run_frame,
-                                                timeline);
+      marker_emit_crossed (timeline);
+
+      /* With animations disabled the first
+       * tick jumps straight to the end.
+       */
+      priv->stats_last_frame = -1;
+      timeline_update_state (priv, af_clock_get_time (priv->clock),
+                             STATE_RUNNING, 0, NULL);
+      _af_clock_add_timeline (priv->clock, timeline);
     }
 }
 
@@ -511,13 +779,11 @@ af_timeline_pause (AfTimeline *timeline)
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  if (priv->source_id)
+  if (timeline_is_running (priv))
     {
-      if (priv->timer)
-        g_timer_stop (priv->timer);
-      
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
+      timeline_update_state (priv, af_clock_get_time (priv->clock),
+                             0, STATE_RUNNING, NULL);
+      _af_clock_remove_timeline (priv->clock, timeline);
       g_signal_emit (timeline, signals [PAUSED], 0);
     }
 }
@@ -532,21 +798,17 @@ void
 af_timeline_stop (AfTimeline *timeline)
 {
   AfTimelinePriv *priv;
+  gdouble progress = 0.0;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  if (priv->source_id)
-    {
-      if (priv->timer)
-        g_timer_stop (priv->timer);
-      
-      g_source_remove (priv->source_id);
-      priv->source_id = 0;
-    }
+  if (timeline_is_running (priv))
+    _af_clock_remove_timeline (priv->clock, timeline);
 
-  priv->last_progress = 0.0;
+  timeline_update_state (priv, af_clock_get_time (priv->clock),
+                         0, STATE_RUNNING, &progress);
 }
 /**
  * af_timeline_rewind:
@@ -558,30 +820,23 @@ void
 af_timeline_rewind (AfTimeline *timeline)
 {
   AfTimelinePriv *priv;
+  gdouble progress;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  /* reset timer */
-  if (priv->timer)
+  if (priv->started)
     {
-      if (af_timeline_get_direction(timeline) != AF_TIMELINE_DIRECTION_FORWARD)
-        {
-      	  priv->last_progress = 1.0;
-
-	  priv->marker_position = g_list_last (priv->marker_list);
-	}
+      if (timeline_direction (priv) != AF_TIMELINE_DIRECTION_FORWARD)
+      	progress = 1.0;
       else
-        {
-	  priv->last_progress = 0;
+	progress = 0.0;
 
-	  priv->marker_position = priv->marker_list;
-	}
+      marker_reset_position (priv);
 
-      g_timer_start (priv->timer);
-      if (!priv->source_id)
-        g_timer_stop (priv->timer);
+      timeline_update_state (priv, af_clock_get_time (priv->clock),
+                             0, 0, &progress);
     }
 }
 
@@ -596,85 +851,92 @@ af_timeline_advance (AfTimeline *timeline,
 		     gdouble     progress)
 {
   AfTimelinePriv *priv;
+  AfTimelineDirection direction;
+  gdouble current;
+  gint64 now;
 
   g_return_if_fail (progress >= 0.0 && progress <= 1.0);
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
+  now = af_clock_get_time (priv->clock);
+  direction = timeline_direction (priv);
+  current = timeline_progress_at (priv, now);
 
-  g_return_if_fail ((priv->direction == AF_TIMELINE_DIRECTION_FORWARD &&
-      priv->last_progress >= progress) || 
-      (priv->direction == AF_TIMELINE_DIRECTION_BACKWARD &&
-      priv->last_progress <= progress));
+  g_return_if_fail ((direction == AF_TIMELINE_DIRECTION_FORWARD &&
+      current >= progress) || 
+      (direction == AF_TIMELINE_DIRECTION_BACKWARD &&
+      current <= progress));
 
-  /* enter critical section */
-  g_static_mutex_lock (&priv->progress_mutex);
-
-  priv->last_progress = progress;
-      
-  marker_skip_progress (timeline, priv->last_progress);
-
-  g_static_mutex_unlock (&priv->progress_mutex);
-  /* leave critical section */
+  timeline_update_state (priv, now, 0, 0, &progress);
+  marker_skip_progress (timeline, progress);
 }
 
 /**
  * af_timeline_get_progress:
  * @timeline: A #AfTimeline
  *
- * The position of the timeline in a [0, 1] interval.
+ * The position of the timeline in a [0, 1] interval. This
+ * function may be called from any thread.
  **/
 gdouble
 af_timeline_get_progress (AfTimeline *timeline)
 {
   AfTimelinePriv *priv;
-  gdouble timer_elapsed;
+  gdouble progress;
+  guint64 state;
+  guint duration;
+  gint64 now;
 
   g_return_val_if_fail (AF_IS_TIMELINE (timeline), 0);
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  timer_elapsed = 0.0;
+  state = timeline_snapshot (priv, &duration, &now);
+  progress = state_progress_at (state, duration, now);
 
-  if (priv->timer)
-    timer_elapsed = (g_timer_elapsed (priv->timer, NULL) * 1000) 
-	            / priv->duration;
-
-  return priv->last_progress + timer_elapsed;
+  return CLAMP (progress, 0., 1.);
 }
 
+/**
+ * af_timeline_set_progress:
+ * @timeline: A #AfTimeline
+ * @progress: new position in a [0, 1] interval
+ *
+ * Moves the timeline to @progress, without emitting any
+ * marker crossed on the way. Unlike most other functions,
+ * this one may be called from any thread, the change is
+ * picked up on the next frame.
+ **/
 void
 af_timeline_set_progress (AfTimeline *timeline,
 		          gdouble     progress)
 {
   AfTimelinePriv *priv;
-  gdouble timer_elapsed;
+  guint64 old_state, new_state;
+  guint duration;
+  gint64 now;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
   g_return_if_fail (progress >= 0 && progress <= 1);
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  timer_elapsed = 0.0;
-  
-  /* enter critical section */
-  g_static_mutex_lock (&priv->progress_mutex);
-
-  if (priv->timer)
-    timer_elapsed = (g_timer_elapsed (priv->timer, NULL) * 1000) 
-	            / priv->duration;
-
-  priv->last_progress = progress - timer_elapsed;
-
-  g_static_mutex_unlock (&priv->progress_mutex);
-  /* leave critical section */
+  do
+    {
+      old_state = timeline_snapshot (priv, &duration, &now);
+      new_state = state_encode (old_state, progress, duration, now);
+    }
+  while (!__atomic_compare_exchange_n (&priv->state, &old_state, new_state, FALSE,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
 }
 
 /**
  * af_timeline_is_running:
  * @timeline: A #AfTimeline
  *
- * Returns whether the timeline is running or not.
+ * Returns whether the timeline is running or not. This
+ * function may be called from any thread.
  *
  * Return Value: %TRUE if the timeline is running
  **/
@@ -687,18 +949,144 @@ af_timeline_is_running (AfTimeline *timeline)
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  return (priv->source_id != 0);
+  return timeline_is_running (priv);
+}
+
+/**
+ * af_timeline_add_frame_func:
+ * @timeline: A #AfTimeline
+ * @func: function to call on every frame
+ * @data: data to pass to @func
+ * @destroy: function to free @data with, or %NULL
+ *
+ * Adds a function to be called on every frame, just like a
+ * #AfTimeline::frame handler would, but without going through
+ * signal marshalling. Functions are called in the order they
+ * were added, before the signal is emitted.
+ *
+ * Return Value: an ID to pass to af_timeline_remove_frame_func()
+ **/
+guint
+af_timeline_add_frame_func (AfTimeline          *timeline,
+                            AfTimelineFrameFunc  func,
+                            gpointer             data,
+                            GDestroyNotify       destroy)
+{
+  AfTimelinePriv *priv;
+  AfFrameFunc frame_func;
+
+  g_return_val_if_fail (AF_IS_TIMELINE (timeline), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  frame_func.func = func;
+  frame_func.data = data;
+  frame_func.destroy = destroy;
+  frame_func.id = ++priv->frame_func_id;
+
+  g_array_append_val (priv->frame_funcs, frame_func);
+
+  return frame_func.id;
+}
+
+/**
+ * af_timeline_remove_frame_func:
+ * @timeline: A #AfTimeline
+ * @id: ID returned by af_timeline_add_frame_func()
+ *
+ * Removes a frame function, it is safe to do so from
+ * within a frame function.
+ **/
+void
+af_timeline_remove_frame_func (AfTimeline *timeline,
+                               guint       id)
+{
+  AfTimelinePriv *priv;
+  AfFrameFunc *frame_func;
+  GDestroyNotify destroy;
+  gpointer data;
+  guint i;
+
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  for (i = 0; i < priv->frame_funcs->len; i++)
+    {
+      frame_func = &g_array_index (priv->frame_funcs, AfFrameFunc, i);
+
+      if (frame_func->id == id && frame_func->func)
+        break;
+    }
+
+  if (i == priv->frame_funcs->len)
+    return;
+
+  /* the func might be running, data is freed afterwards */
+  if (priv->in_frame_funcs)
+    {
+      frame_func->func = NULL;
+      priv->n_removed_frame_funcs++;
+      return;
+    }
+
+  destroy = frame_func->destroy;
+  data = frame_func->data;
+  g_array_remove_index (priv->frame_funcs, i);
+
+  if (destroy)
+    (destroy) (data);
 }
 
 /* Marker API Start */
 
+/* Refreshes the name table entries of the markers from @first
+ * on, after an insertion or removal moved them. A stale table
+ * is left for marker_lookup() to rebuild as a whole.
+ */
+static void
+marker_names_update (AfTimelinePriv *priv,
+                     guint           first)
+{
+  guint i;
+
+  if (priv->marker_names_stale)
+    return;
+
+  for (i = first; i < priv->markers->len; i++)
+    g_hash_table_insert (priv->marker_names,
+                         GUINT_TO_POINTER (g_array_index (priv->markers, AfMarker, i).name),
+                         GUINT_TO_POINTER (i + 1));
+}
+
+/* Keeps marker_position on the same marker */
+static void
+marker_insert (AfTimelinePriv *priv,
+               GQuark          name,
+               gdouble         progress)
+{
+  AfMarker marker;
+  guint index;
+
+  marker.name = name;
+  marker.progress = progress;
+  index = marker_upper_bound (priv, progress);
+
+  g_array_insert_val (priv->markers, index, marker);
+  g_hash_table_insert (priv->marker_names, GUINT_TO_POINTER (name), NULL);
+  marker_names_update (priv, index);
+
+  if ((gint) index <= priv->marker_position)
+    priv->marker_position++;
+}
+
 void
 af_timeline_add_marker (AfTimeline  *timeline,
 		        const gchar *marker_name,
 		        gdouble      progress)
 {
   AfTimelinePriv *priv;
-  AfMarker *marker;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
   g_return_if_fail (marker_name != NULL);
@@ -707,33 +1095,87 @@ af_timeline_add_marker (AfTimeline  *timeline,
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  marker = g_slice_new (AfMarker);
+  marker_insert (priv, g_quark_from_string (marker_name), progress);
+}
+
+static gint
+marker_compare_progress (gconstpointer a,
+		         gconstpointer b)
+{
+  const AfMarker *marker_a = a;
+  const AfMarker *marker_b = b;
 
-  marker->name = g_strdup (marker_name);
-  marker->progress = progress;
+  if (marker_a->progress == marker_b->progress)
+    return 0;
 
-  priv->marker_list = g_list_insert_sorted (priv->marker_list, marker, 
-		                            marker_compare_progress);
+  return (marker_a->progress < marker_b->progress) ? -1 : 1;
 }
 
-/*
+/**
+ * af_timeline_add_markers:
+ * @timeline: A #AfTimeline
+ * @marker_names: array of @n_markers marker names
+ * @progress: array of @n_markers progress values
+ * @n_markers: number of markers to add
+ *
+ * Adds several markers at once, sorting them only once. Names
+ * that already exist on @timeline, or earlier in the arrays,
+ * are skipped with a warning.
+ **/
 void
-af_timeline_add_marker_at_time (AfTimeline  *timeline,
-		                const gchar *marker_name,
-			        guint        msec)
+af_timeline_add_markers (AfTimeline         *timeline,
+                         const gchar *const *marker_names,
+                         const gdouble      *progress,
+                         guint               n_markers)
 {
   AfTimelinePriv *priv;
-  gdouble progress;
+  GQuark position_name = 0;
+  guint i;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
+  g_return_if_fail (n_markers == 0 || (marker_names != NULL && progress != NULL));
+
+  for (i = 0; i < n_markers; i++)
+    {
+      g_return_if_fail (marker_names[i] != NULL);
+      g_return_if_fail (progress[i] >= 0.0 && progress[i] <= 1.0);
+    }
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  progress = (gdouble) msec / priv->duration;
+  if (priv->marker_position >= 0 &&
+      priv->marker_position < (gint) priv->markers->len)
+    position_name = g_array_index (priv->markers, AfMarker,
+                                   priv->marker_position).name;
+
+  for (i = 0; i < n_markers; i++)
+    {
+      AfMarker marker;
+
+      marker.name = g_quark_from_string (marker_names[i]);
+      marker.progress = progress[i];
+
+      if (g_hash_table_lookup_extended (priv->marker_names,
+                                        GUINT_TO_POINTER (marker.name),
+                                        NULL, NULL))
+        {
+          g_warning ("Marker '%s' already exists", marker_names[i]);
+          continue;
+        }
+
+      g_array_append_val (priv->markers, marker);
+      g_hash_table_insert (priv->marker_names, GUINT_TO_POINTER (marker.name), NULL);
+    }
+
+  g_array_sort (priv->markers, marker_compare_progress);
+  priv->marker_names_stale = TRUE;
 
-  af_timeline_add_marker_impl (timeline, marker_name, progress);
+  /* put the position back on the marker it was on */
+  if (position_name)
+    priv->marker_position = marker_lookup (priv, g_quark_to_string (position_name));
+  else if (priv->marker_position >= 0)
+    priv->marker_position = priv->markers->len;
 }
-*/
 
 /**
  * af_timeline_has_marker:
@@ -746,16 +1188,19 @@ af_timeline_has_marker (AfTimeline  *timeline,
 		        const gchar *marker_name)
 {
   AfTimelinePriv *priv;
+  GQuark name;
 
   g_return_val_if_fail (AF_IS_TIMELINE (timeline), FALSE);
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
+  name = g_quark_try_string (marker_name);
 
-  if (g_list_find_custom (priv->marker_list, marker_name, 
-			  marker_compare_name_with_string))
-    return TRUE;
+  if (!name)
+    return FALSE;
 
-  return FALSE;
+  return g_hash_table_lookup_extended (priv->marker_names,
+                                       GUINT_TO_POINTER (name),
+                                       NULL, NULL);
 }
 
 gchar**
@@ -764,12 +1209,8 @@ af_timeline_list_markers (AfTimeline *timeline,
 			  gdouble     end_progress)
 {
   AfTimelinePriv *priv;
-  GList *element, *iterator;
   gchar** list;
-  gint count, index;
-
-  count = index = 0;
-  list = NULL;
+  guint start, end, i;
 
   g_return_val_if_fail (AF_IS_TIMELINE (timeline), NULL);
   g_return_val_if_fail (start_progress <= end_progress, NULL);
@@ -778,41 +1219,18 @@ af_timeline_list_markers (AfTimeline *timeline,
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  element = priv->marker_list;
+  start = marker_lower_bound (priv, start_progress);
+  end = marker_upper_bound (priv, end_progress);
 
-  if (!element)
+  if (start >= end)
     return NULL;
 
-  if (start_progress == 0 && end_progress == 1)
-    count = g_list_length (element);
-  else
-    {
-      while (element && (((AfMarker *)element->data)->progress < start_progress))
-        element = g_list_next (element);
-
-      if (!element)
-        return NULL;
-
-      iterator = element;
-
-      while (iterator && (((AfMarker *)iterator->data)->progress >= start_progress)
-	      && (((AfMarker *)iterator->data)->progress <= end_progress))
-        {
-          count += 1;
-          iterator = g_list_next (iterator);
-	}
-    }
-  
-  list = g_new0 (gchar*, count + 1);
-
-  while (element && index < count)
-    {
-      list[index++] = g_strdup (((AfMarker *)element->data)->name);
+  list = g_new (gchar*, end - start + 1);
 
-      element = g_list_next (element);
-    }
+  for (i = start; i < end; i++)
+    list[i - start] = g_strdup (g_quark_to_string (g_array_index (priv->markers, AfMarker, i).name));
 
-  list[index] = NULL;
+  list[end - start] = NULL;
 
   return list;
 }
@@ -822,26 +1240,26 @@ af_timeline_remove_marker (AfTimeline  *timeline,
 		           const gchar *marker_name)
 {
   AfTimelinePriv *priv;
-  GList *element;
+  gint index;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
+  index = marker_lookup (priv, marker_name);
 
-  if (!priv->marker_list)
-    return;
-
-  element = g_list_find_custom (priv->marker_list, marker_name, 
-			        marker_compare_name_with_string);
-
-  if (!element)
+  if (index < 0)
     return;
 
-  priv->marker_list = g_list_remove_link (priv->marker_list, element);
+  g_hash_table_remove (priv->marker_names,
+                       GUINT_TO_POINTER (g_array_index (priv->markers, AfMarker, index).name));
+  g_array_remove_index (priv->markers, index);
+  marker_names_update (priv, index);
 
-  marker_free (element->data, NULL);
-
-  g_list_free (element);
+  /* keep pointing to the same marker, or to the next one */
+  if (index < priv->marker_position ||
+      (index == priv->marker_position &&
+       timeline_direction (priv) == AF_TIMELINE_DIRECTION_BACKWARD))
+    priv->marker_position--;
 }
 
 /**
@@ -855,22 +1273,18 @@ af_timeline_advance_to_marker (AfTimeline  *timeline,
 		               const gchar *marker_name)
 {
   AfTimelinePriv *priv;
-  GList *element;
-
-  element = NULL;
+  gint index;
 
   g_return_val_if_fail (AF_IS_TIMELINE (timeline), FALSE);
   g_return_val_if_fail (marker_name != NULL, FALSE);
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
+  index = marker_lookup (priv, marker_name);
 
-  element = g_list_find_custom (priv->marker_list, marker_name, 
-			        marker_compare_name_with_string);
-
-  if (!element)
+  if (index < 0)
     return FALSE;
 
-  af_timeline_advance (timeline, ((AfMarker *)element->data)->progress);
+  af_timeline_advance (timeline, g_array_index (priv->markers, AfMarker, index).progress);
 
   return TRUE;
 }
@@ -918,12 +1332,7 @@ af_timeline_set_fps (AfTimeline *timeline,
   priv->fps = fps;
 
   if (af_timeline_is_running (timeline))
-    {
-      g_source_remove (priv->source_id);
-      priv->source_id = gdk_threads_add_timeout (FRAME_INTERVAL (priv->fps),
-						 (GSourceFunc) af_timeline_run_frame,
-						 timeline);
-    }
+    _af_clock_update (priv->clock);
 
   g_object_notify (G_OBJECT (timeline), "fps");
 }
@@ -979,8 +1388,7 @@ af_timeline_set_duration (AfTimeline *timeline,
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
-
-  priv->duration = duration;
+  timeline_set_timing (priv, duration, priv->clock);
 
   g_object_notify (G_OBJECT (timeline), "duration");
 }
@@ -1001,7 +1409,8 @@ af_timeline_get_duration (AfTimeline *timeline)
  * af_timeline_get_direction:
  * @timeline: A #AfTimeline
  *
- * Returns the direction of the timeline.
+ * Returns the direction of the timeline. This function
+ * may be called from any thread.
  *
  * Return Value: direction
  **/
@@ -1013,7 +1422,7 @@ af_timeline_get_direction (AfTimeline *timeline)
   g_return_val_if_fail (AF_IS_TIMELINE (timeline), AF_TIMELINE_DIRECTION_FORWARD);
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
-  return priv->direction;
+  return timeline_direction (priv);
 }
 
 /**
@@ -1032,7 +1441,17 @@ af_timeline_set_direction (AfTimeline          *timeline,
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
-  priv->direction = direction;
+
+  /* the next marker to cross is now on the other side */
+  if (timeline_direction (priv) != direction)
+    priv->marker_position += (direction == AF_TIMELINE_DIRECTION_FORWARD) ? 1 : -1;
+
+  if (direction == AF_TIMELINE_DIRECTION_BACKWARD)
+    timeline_update_state (priv, af_clock_get_time (priv->clock),
+                           STATE_BACKWARD, 0, NULL);
+  else
+    timeline_update_state (priv, af_clock_get_time (priv->clock),
+                           0, STATE_BACKWARD, NULL);
 
   g_object_notify (G_OBJECT (timeline), "direction");
 }
@@ -1067,102 +1486,386 @@ af_timeline_set_screen (AfTimeline *timeline,
   g_object_notify (G_OBJECT (timeline), "screen");
 }
 
+/**
+ * af_timeline_get_clock:
+ * @timeline: A #AfTimeline
+ *
+ * Returns the clock driving the timeline.
+ *
+ * Return Value: the #AfClock, owned by the timeline
+ **/
+AfClock *
+af_timeline_get_clock (AfTimeline *timeline)
+{
+  AfTimelinePriv *priv;
+
+  g_return_val_if_fail (AF_IS_TIMELINE (timeline), NULL);
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+  return priv->clock;
+}
+
+/**
+ * af_timeline_set_clock:
+ * @timeline: A #AfTimeline
+ * @clock: A #AfClock
+ *
+ * Binds the timeline to @clock, which will provide
+ * both its notion of time and its frame ticks. The
+ * current progress is kept if the timeline is running.
+ **/
+void
+af_timeline_set_clock (AfTimeline *timeline,
+                       AfClock    *clock)
+{
+  AfTimelinePriv *priv;
+  gboolean running;
+
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+  g_return_if_fail (AF_IS_CLOCK (clock));
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (priv->clock == clock)
+    return;
+
+  running = timeline_is_running (priv);
+
+  if (running)
+    _af_clock_remove_timeline (priv->clock, timeline);
+
+  timeline_set_timing (priv, priv->duration, clock);
+
+  if (running)
+    _af_clock_add_timeline (priv->clock, timeline);
+
+  g_object_notify (G_OBJECT (timeline), "clock");
+}
+
 gdouble
 af_timeline_calculate_progress (gdouble                linear_progress,
                                 AfTimelineProgressType progress_type)
 {
+  return _af_easing_calculate (linear_progress, progress_type);
+}
+
+static guint64
+state_encode (guint64 flags,
+              gdouble progress,
+              guint   duration,
+              gint64  now)
+{
+  gdouble payload;
+
+  flags &= STATE_RUNNING | STATE_BACKWARD | STATE_EPOCH_MASK;
+  progress = CLAMP (progress, -STATE_PROGRESS_MAX, STATE_PROGRESS_MAX);
+
+  if ((flags & STATE_RUNNING) && duration > 0)
+    {
+      gdouble offset;
+
+      offset = progress * duration * 1000 * STATE_TIME_SCALE;
+      payload = (gdouble) now * STATE_TIME_SCALE;
+      payload += (flags & STATE_BACKWARD) ? offset : -offset;
+      flags |= STATE_TIMED;
+    }
+  else
+    payload = progress * STATE_PROGRESS_SCALE;
+
+  payload = CLAMP (payload, -STATE_PAYLOAD_MAX, STATE_PAYLOAD_MAX);
+  payload += (payload < 0) ? -0.5 : 0.5;
+
+  return ((guint64) (gint64) payload << STATE_FLAGS_BITS) | flags;
+}
+
+static gdouble
+state_progress_at (guint64 state,
+                   guint   duration,
+                   gint64  now)
+{
+  gint64 payload;
   gdouble progress;
 
-  progress = linear_progress;
+  /* arithmetic shift keeps the payload sign */
+  payload = (gint64) state >> STATE_FLAGS_BITS;
 
-  switch (progress_type)
+  if (state & STATE_TIMED)
     {
-    case AF_TIMELINE_PROGRESS_LINEAR:
-      break;
-    case AF_TIMELINE_PROGRESS_SINUSOIDAL:
-      progress = sinf ((progress * G_PI) / 2);
-      break;
-    case AF_TIMELINE_PROGRESS_EXPONENTIAL:
-      progress *= progress;
-      break;
-    case AF_TIMELINE_PROGRESS_EASE_IN_EASE_OUT:
-      {
-        progress *= 2;
-
-        if (progress < 1)
-          progress = pow (progress, 3) / 2;
-        else
-          progress = (pow (progress - 2, 3) + 2) / 2;
-      }
+      if (G_UNLIKELY (duration == 0))
+        return (state & STATE_BACKWARD) ? 0. : 1.;
+
+      progress = (gdouble) (now * STATE_TIME_SCALE - payload) /
+                 ((gdouble) duration * 1000 * STATE_TIME_SCALE);
+
+      return (state & STATE_BACKWARD) ? -progress : progress;
     }
 
+  progress = (gdouble) payload / STATE_PROGRESS_SCALE;
+
+  /* running with no duration, the first frame is the last */
+  if (state & STATE_RUNNING)
+    progress += (state & STATE_BACKWARD) ? -1. : 1.;
+
   return progress;
 }
 
+static inline guint64
+timeline_load_state (AfTimelinePriv *priv)
+{
+  return __atomic_load_n (&priv->state, __ATOMIC_ACQUIRE);
+}
+
+static gboolean
+timeline_is_running (AfTimelinePriv *priv)
+{
+  return (timeline_load_state (priv) & STATE_RUNNING) != 0;
+}
+
+static AfTimelineDirection
+timeline_direction (AfTimelinePriv *priv)
+{
+  if (timeline_load_state (priv) & STATE_BACKWARD)
+    return AF_TIMELINE_DIRECTION_BACKWARD;
+
+  return AF_TIMELINE_DIRECTION_FORWARD;
+}
+
+static gdouble
+timeline_progress_at (AfTimelinePriv *priv,
+                      gint64          now)
+{
+  return state_progress_at (timeline_load_state (priv), priv->duration, now);
+}
+
+/* Reads the state word along with the duration and clock time
+ * it is relative to, for functions that may be called from any
+ * thread. A state from another epoch than the published timing
+ * means set_timing() is halfway through. The clock is kept
+ * referenced while used, as set_timing() may drop it.
+ */
+static guint64
+timeline_snapshot (AfTimelinePriv *priv,
+                   guint          *duration,
+                   gint64         *now)
+{
+  AfClock *clock;
+  guint64 state;
+  guint epoch;
+
+  for (;;)
+    {
+      state = timeline_load_state (priv);
+
+      g_bit_lock (&priv->timing_lock, 0);
+      clock = g_object_ref (priv->clock);
+      *duration = priv->duration;
+      epoch = priv->epoch;
+      g_bit_unlock (&priv->timing_lock, 0);
+
+      if (epoch == STATE_EPOCH (state))
+        break;
+
+      g_object_unref (clock);
+      g_thread_yield ();
+    }
+
+  *now = af_clock_get_time (clock);
+  g_object_unref (clock);
+
+  return state;
+}
+
+/* Replaces the duration and clock, and moves the state word to
+ * a new epoch keeping its progress. Main thread only, so the
+ * previous timing is still the one in priv until published.
+ */
+static void
+timeline_set_timing (AfTimelinePriv *priv,
+                     guint           duration,
+                     AfClock        *clock)
+{
+  AfClock *old_clock;
+  guint64 old_state, new_state, epoch;
+  guint old_duration;
+  gint64 old_now, now;
+  gdouble progress;
+
+  old_clock = priv->clock;
+  old_duration = priv->duration;
+  old_now = af_clock_get_time (old_clock);
+  now = af_clock_get_time (clock);
+
+  g_bit_lock (&priv->timing_lock, 0);
+  priv->clock = g_object_ref (clock);
+  priv->duration = duration;
+  priv->epoch = (priv->epoch + 1) & STATE_EPOCH_MAX;
+  epoch = priv->epoch;
+  g_bit_unlock (&priv->timing_lock, 0);
+
+  /* other threads may still seek in the previous epoch */
+  old_state = timeline_load_state (priv);
+
+  do
+    {
+      progress = state_progress_at (old_state, old_duration, old_now);
+      new_state = state_encode ((old_state & ~STATE_EPOCH_MASK) |
+                                (epoch << STATE_EPOCH_SHIFT),
+                                progress, duration, now);
+    }
+  while (!__atomic_compare_exchange_n (&priv->state, &old_state, new_state, TRUE,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  g_object_unref (old_clock);
+}
+
+/* Sets and clears flags in the state word, and moves it
+ * to @progress, or keeps the progress it has at @now if
+ * %NULL. Seeking threads may race with the main loop
+ * here, whoever comes last wins.
+ */
+static void
+timeline_update_state (AfTimelinePriv *priv,
+                       gint64          now,
+                       guint           set_flags,
+                       guint           clear_flags,
+                       const gdouble  *progress)
+{
+  guint64 old_state, new_state;
+  gdouble new_progress;
+
+  old_state = timeline_load_state (priv);
+
+  do
+    {
+      if (progress)
+        new_progress = *progress;
+      else
+        new_progress = state_progress_at (old_state, priv->duration, now);
+
+      new_state = state_encode ((old_state | set_flags) & ~clear_flags,
+                                new_progress, priv->duration, now);
+    }
+  while (!__atomic_compare_exchange_n (&priv->state, &old_state, new_state, TRUE,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+/* Wraps a looping timeline around keeping the overshoot,
+ * so it does not drift. Handlers or other threads may have
+ * moved the timeline already, so only wrap if still needed.
+ */
+static void
+timeline_wrap (AfTimelinePriv *priv,
+               gint64          now)
+{
+  guint64 old_state, new_state;
+  gdouble progress;
+
+  old_state = timeline_load_state (priv);
+
+  do
+    {
+      if (!(old_state & STATE_RUNNING))
+        return;
+
+      progress = state_progress_at (old_state, priv->duration, now);
+
+      if (old_state & STATE_BACKWARD)
+        {
+          if (progress > 0.0)
+            return;
+          progress += 1.0;
+        }
+      else
+        {
+          if (progress < 1.0)
+            return;
+          progress -= 1.0;
+        }
+
+      new_state = state_encode (old_state, progress, priv->duration, now);
+    }
+  while (!__atomic_compare_exchange_n (&priv->state, &old_state, new_state, TRUE,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
 /* Marker help functions */
+static void
+marker_emit (AfTimeline *timeline,
+             AfMarker   *marker)
+{
+  AfTimelinePriv *priv;
+  const gchar *name;
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+  name = g_quark_to_string (marker->name);
+
+  g_ptr_array_add (priv->crossed_markers, (gpointer) name);
+  g_signal_emit (timeline, signals [MARKER], marker->name, name);
+}
+
+/* Emits "markers" with everything crossed since the last call */
+static void
+marker_emit_crossed (AfTimeline *timeline)
+{
+  AfTimelinePriv *priv;
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (priv->crossed_markers->len == 0)
+    return;
+
+  g_ptr_array_add (priv->crossed_markers, NULL);
+  g_signal_emit (timeline, signals [MARKERS], 0, priv->crossed_markers->pdata);
+  g_ptr_array_set_size (priv->crossed_markers, 0);
+}
+
 static void
 marker_emit_signals (AfTimeline *timeline,
 		     gdouble     progress,
 		     gboolean    equal)
 {
   AfTimelinePriv *priv;
+  AfMarker *marker;
 
   g_return_if_fail (AF_IS_TIMELINE (timeline));
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  if (priv->marker_position)
+  if (!priv->started)
+    return;
+
+  /* handlers may add or remove markers, so
+   * bounds are checked again on every step.
+   */
+  if (timeline_direction (priv) == AF_TIMELINE_DIRECTION_FORWARD)
     {
-      if (priv->direction == AF_TIMELINE_DIRECTION_FORWARD)
-	{
-          if (equal == FALSE)
-	    {
-	        while (priv->marker_position && 
-		       ((AfMarker *)priv->marker_position->data)->progress 
-		       < progress)
-	          {
-                    g_signal_emit (timeline, signals [MARKER], 0, 
-			           ((AfMarker *)priv->marker_position->data)->name);
-	            priv->marker_position = g_list_next (priv->marker_position);
-	          }
-	    }	    
-	  else
-	    {	  
-	        while (priv->marker_position && 
-		       ((AfMarker *)priv->marker_position->data)->progress 
-		       <= progress)
-	          {
-                    g_signal_emit (timeline, signals [MARKER], 0, 
-			           ((AfMarker *)priv->marker_position->data)->name);
-	            priv->marker_position = g_list_next (priv->marker_position);
-	          }
-	    }
-	}
-      else
-	{
-	  if (equal == FALSE)
-	    {
-              while (priv->marker_position && 
-	             ((AfMarker *)priv->marker_position->data)->progress 
-		     > progress)
-	        {
-                  g_signal_emit (timeline, signals [MARKER], 0, 
-			         ((AfMarker *)priv->marker_position->data)->name);
-	          priv->marker_position = g_list_previous (priv->marker_position);
-	        }
-	    }
-	  else
-	    {
-              while (priv->marker_position && 
-	             ((AfMarker *)priv->marker_position->data)->progress 
-		     >= progress)
-	        {
-                  g_signal_emit (timeline, signals [MARKER], 0, 
-			         ((AfMarker *)priv->marker_position->data)->name);
-	          priv->marker_position = g_list_previous (priv->marker_position);
-	        }
-	    }
-	}
+      while (priv->marker_position >= 0 &&
+             priv->marker_position < (gint) priv->markers->len)
+        {
+          marker = &g_array_index (priv->markers, AfMarker, priv->marker_position);
+
+          if (marker->progress > progress ||
+              (!equal && marker->progress == progress))
+            break;
+
+          priv->marker_position++;
+          marker_emit (timeline, marker);
+        }
+    }
+  else
+    {
+      while (priv->marker_position >= 0 &&
+             priv->marker_position < (gint) priv->markers->len)
+        {
+          marker = &g_array_index (priv->markers, AfMarker, priv->marker_position);
+
+          if (marker->progress < progress ||
+              (!equal && marker->progress == progress))
+            break;
+
+          priv->marker_position--;
+          marker_emit (timeline, marker);
+        }
     }
 }
 
@@ -1176,83 +1879,221 @@ marker_skip_progress (AfTimeline *timeline,
 
   priv = AF_TIMELINE_GET_PRIV (timeline);
 
-  if (priv->marker_position)
+  if (timeline_direction (priv) == AF_TIMELINE_DIRECTION_FORWARD)
+    priv->marker_position = marker_upper_bound (priv, progress);
+  else
+    priv->marker_position = (gint) marker_lower_bound (priv, progress) - 1;
+}
+
+static void
+marker_reset_position (AfTimelinePriv *priv)
+{
+  if (timeline_direction (priv) == AF_TIMELINE_DIRECTION_FORWARD)
+    priv->marker_position = 0;
+  else
+    priv->marker_position = (gint) priv->markers->len - 1;
+}
+
+/* index of the first marker at or after progress */
+static guint
+marker_lower_bound (AfTimelinePriv *priv,
+                    gdouble         progress)
+{
+  guint min, max;
+
+  min = 0;
+  max = priv->markers->len;
+
+  while (min < max)
     {
-      if (priv->direction == AF_TIMELINE_DIRECTION_FORWARD)
-	{
-          while (priv->marker_position && 
-		 ((AfMarker *)priv->marker_position->data)->progress 
-		 <= progress)
-            priv->marker_position = g_list_next (priv->marker_position);
-	}
+      guint mid = (min + max) / 2;
+
+      if (g_array_index (priv->markers, AfMarker, mid).progress < progress)
+        min = mid + 1;
       else
-	{
-          while (priv->marker_position && 
-	         ((AfMarker *)priv->marker_position->data)->progress 
-		 >= progress)
-            priv->marker_position = g_list_previous (priv->marker_position);
-	}
+        max = mid;
     }
+
+  return min;
 }
 
-static gint 
-marker_compare_progress (gconstpointer a,
-		         gconstpointer b)
+/* index of the first marker after progress */
+static guint
+marker_upper_bound (AfTimelinePriv *priv,
+                    gdouble         progress)
 {
-  gdouble difference;
- 
-  difference = ((AfMarker *)a)->progress - ((AfMarker *)b)->progress;
-  
-  if (difference == 0)
-    return 0;
+  guint min, max;
 
-  if (difference < 0)
-    return -1;
+  min = 0;
+  max = priv->markers->len;
+
+  while (min < max)
+    {
+      guint mid = (min + max) / 2;
+
+      if (g_array_index (priv->markers, AfMarker, mid).progress <= progress)
+        min = mid + 1;
+      else
+        max = mid;
+    }
 
-  return 1; 
+  return min;
 }
 
-/*
+/* Returns the index of the marker, or -1 */
 static gint
-marker_compare_name_with_progress (gconstpointer a,
-		                   gconstpointer b)
-{
-  gdouble difference;
- 
-  difference = ((AfMarker *)a)->progress - *((const gdouble *)b);
-  
-  if (difference == 0)
-    return 0;
+marker_lookup (AfTimelinePriv *priv,
+               const gchar    *marker_name)
+{
+  gpointer index;
+  GQuark name;
+
+  name = g_quark_try_string (marker_name);
+
+  if (!name)
+    return -1;
+
+  if (priv->marker_names_stale)
+    {
+      guint i;
+
+      for (i = 0; i < priv->markers->len; i++)
+        g_hash_table_insert (priv->marker_names,
+                             GUINT_TO_POINTER (g_array_index (priv->markers, AfMarker, i).name),
+                             GUINT_TO_POINTER (i + 1));
 
-  if (difference < 0)
+      priv->marker_names_stale = FALSE;
+    }
+
+  index = g_hash_table_lookup (priv->marker_names, GUINT_TO_POINTER (name));
+
+  if (!index)
     return -1;
 
-  return 1; 
+  return (gint) GPOINTER_TO_UINT (index) - 1;
 }
 
-static gint 
-marker_compare_name (gconstpointer a,
-		     gconstpointer b)
+/**
+ * af_timeline_get_collect_stats:
+ * @timeline: A #AfTimeline
+ *
+ * Returns whether frame timing statistics are collected.
+ **/
+gboolean
+af_timeline_get_collect_stats (AfTimeline *timeline)
 {
-  return g_strcmp0 (((AfMarker *)a)->name, ((AfMarker *)b)->name);
+  AfTimelinePriv *priv;
+
+  g_return_val_if_fail (AF_IS_TIMELINE (timeline), FALSE);
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  return (priv->stats != NULL);
 }
-*/
 
-static gint
-marker_compare_name_with_string (gconstpointer a,
-		                 gconstpointer b)
+/**
+ * af_timeline_set_collect_stats:
+ * @timeline: A #AfTimeline
+ * @collect_stats: whether to collect statistics
+ *
+ * Enables collecting frame timing statistics for @timeline, which
+ * are also added to the global ones. Disabling it discards them.
+ * Setting the AF_TIMELINE_STATS environment variable turns this
+ * on for every timeline.
+ **/
+void
+af_timeline_set_collect_stats (AfTimeline *timeline,
+                               gboolean    collect_stats)
 {
-  return g_strcmp0 (((AfMarker *)a)->name, (const gchar *)b);
+  AfTimelinePriv *priv;
+
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (collect_stats == (priv->stats != NULL))
+    return;
+
+  if (collect_stats)
+    {
+      priv->stats = g_slice_new0 (AfTimelineStats);
+      priv->stats_last_frame = -1;
+    }
+  else
+    {
+      g_slice_free (AfTimelineStats, priv->stats);
+      priv->stats = NULL;
+    }
+
+  g_object_notify (G_OBJECT (timeline), "collect-stats");
 }
 
-static void
-marker_free (gpointer data,
-	     gpointer user_data)
+/**
+ * af_timeline_get_stats:
+ * @timeline: A #AfTimeline
+ * @stats: return location for the statistics
+ *
+ * Fills in the frame timing statistics collected so far,
+ * or all zeros if @timeline does not collect them.
+ **/
+void
+af_timeline_get_stats (AfTimeline      *timeline,
+                       AfTimelineStats *stats)
 {
-  AfMarker *marker;
+  AfTimelinePriv *priv;
 
-  marker = (AfMarker *)data;
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+  g_return_if_fail (stats != NULL);
 
-  g_free (marker->name);
-  g_slice_free (AfMarker, marker);
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (priv->stats)
+    *stats = *priv->stats;
+  else
+    memset (stats, 0, sizeof (AfTimelineStats));
+}
+
+/**
+ * af_timeline_reset_stats:
+ * @timeline: A #AfTimeline
+ *
+ * Clears the statistics collected so far for @timeline.
+ **/
+void
+af_timeline_reset_stats (AfTimeline *timeline)
+{
+  AfTimelinePriv *priv;
+
+  g_return_if_fail (AF_IS_TIMELINE (timeline));
+
+  priv = AF_TIMELINE_GET_PRIV (timeline);
+
+  if (priv->stats)
+    memset (priv->stats, 0, sizeof (AfTimelineStats));
+}
+
+/**
+ * af_timeline_get_global_stats:
+ * @stats: return location for the statistics
+ *
+ * Fills in the frame timing statistics aggregated over
+ * every timeline that collects them.
+ **/
+void
+af_timeline_get_global_stats (AfTimelineStats *stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  *stats = global_stats;
+}
+
+/**
+ * af_timeline_reset_global_stats:
+ *
+ * Clears the aggregated frame timing statistics.
+ **/
+void
+af_timeline_reset_global_stats (void)
+{
+  memset (&global_stats, 0, sizeof (AfTimelineStats));
 }
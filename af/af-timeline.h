@@ -24,6 +24,7 @@
 #include <glib-object.h>
 #include "af-enums.h"
 #include "af-enumtypes.h"
+#include "af-clock.h"
 
 G_BEGIN_DECLS
 
@@ -36,6 +37,14 @@ G_BEGIN_DECLS
 
 typedef struct AfTimeline      AfTimeline;
 typedef struct AfTimelineClass AfTimelineClass;
+typedef struct AfTimelineStats AfTimelineStats;
+
+typedef void (* AfTimelineFrameFunc) (AfTimeline *timeline,
+                                      gdouble     progress,
+                                      gpointer    user_data);
+
+typedef gdouble (* AfTimelineProgressFunc) (gdouble  linear_progress,
+                                            gpointer user_data);
 
 struct AfTimeline
 {
@@ -55,13 +64,33 @@ struct AfTimelineClass
   void (* marker)            (AfTimeline *timeline,
 			      gdouble     progress,
 			      gchar      *marker_name);
+  void (* markers)           (AfTimeline *timeline,
+			      gchar     **marker_names);
 
-  void (* __gtk_reserved1) (void);
   void (* __gtk_reserved2) (void);
   void (* __gtk_reserved3) (void);
   void (* __gtk_reserved4) (void);
 };
 
+#define AF_TIMELINE_STATS_N_BUCKETS 16
+
+/* Frame timing statistics, times are in microseconds. Histogram
+ * bucket i counts samples below 256 << i, the last bucket counts
+ * everything else.
+ */
+struct AfTimelineStats
+{
+  guint64 n_frames;
+  guint64 n_late_frames;
+  guint64 n_skipped_intervals;
+
+  gint64 worst_interval;
+  gint64 worst_handler_time;
+
+  guint64 interval_histogram[AF_TIMELINE_STATS_N_BUCKETS];
+  guint64 handler_histogram[AF_TIMELINE_STATS_N_BUCKETS];
+};
+
 
 GType                 af_timeline_get_type           (void) G_GNUC_CONST;
 
@@ -82,9 +111,20 @@ void                  af_timeline_set_progress       (AfTimeline              *t
 
 gboolean              af_timeline_is_running         (AfTimeline              *timeline);
 
+guint                 af_timeline_add_frame_func     (AfTimeline              *timeline,
+                                                      AfTimelineFrameFunc      func,
+                                                      gpointer                 data,
+                                                      GDestroyNotify           destroy);
+void                  af_timeline_remove_frame_func  (AfTimeline              *timeline,
+                                                      guint                    id);
+
 void                  af_timeline_add_marker         (AfTimeline             *timeline,
 		                                      const gchar            *marker_name,
 				                      gdouble                 progress);
+void                  af_timeline_add_markers        (AfTimeline             *timeline,
+                                                      const gchar *const     *marker_names,
+                                                      const gdouble          *progress,
+                                                      guint                   n_markers);
 gboolean              af_timeline_has_marker          (AfTimeline             *timeline,
 		                                       const gchar            *marker_name);
 gchar**               af_timeline_list_markers        (AfTimeline             *timeline,
@@ -115,8 +155,34 @@ AfTimelineDirection   af_timeline_get_direction      (AfTimeline              *t
 void                  af_timeline_set_direction      (AfTimeline              *timeline,
                                                       AfTimelineDirection      direction);
 
+AfClock              *af_timeline_get_clock          (AfTimeline              *timeline);
+void                  af_timeline_set_clock          (AfTimeline              *timeline,
+                                                      AfClock                 *clock);
+
+gboolean              af_timeline_get_collect_stats  (AfTimeline              *timeline);
+void                  af_timeline_set_collect_stats  (AfTimeline              *timeline,
+                                                      gboolean                 collect_stats);
+void                  af_timeline_get_stats          (AfTimeline              *timeline,
+                                                      AfTimelineStats         *stats);
+void                  af_timeline_reset_stats        (AfTimeline              *timeline);
+void                  af_timeline_get_global_stats   (AfTimelineStats         *stats);
+void                  af_timeline_reset_global_stats (void);
+
 gdouble               af_timeline_calculate_progress (gdouble                  linear_progress,
                                                       AfTimelineProgressType   progress_type);
+void                  af_timeline_calculate_progress_batch (const gdouble                *linear_progress,
+                                                            const AfTimelineProgressType *progress_types,
+                                                            gdouble                      *progress,
+                                                            guint                         n_values);
+
+AfTimelineProgressType af_timeline_register_cubic_bezier  (gdouble                x1,
+                                                           gdouble                y1,
+                                                           gdouble                x2,
+                                                           gdouble                y2);
+AfTimelineProgressType af_timeline_register_steps         (guint                  n_steps,
+                                                           gboolean               jump_start);
+AfTimelineProgressType af_timeline_register_progress_func (AfTimelineProgressFunc func,
+                                                           gpointer               user_data);
 
 G_END_DECLS
 
@@ -0,0 +1,717 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* af-bench.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Headless benchmarks. Frames are driven through manual clocks,
+ * so no display or main loop is needed. Every benchmark prints
+ * one JSON object per line:
+ *
+ *   {"name": "...", "iterations": N, "ns_per_op": X, "allocs_per_op": Y}
+ *
+ * allocs_per_op is -1 where allocations can't be counted.
+ *
+ * Usage: af-bench [SUBSTRING]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include <af/af-animator.h>
+#include <af/af-timeline.h>
+#include <af/af-clock.h>
+
+#define MIN_TIME_USEC    200000
+#define FRAME_USEC       16667
+#define LONG_DURATION    1000000
+#define N_EASING_VALUES  1024
+#define N_MARKERS        10000
+
+/* Allocation counting: on glibc, malloc and friends are
+ * interposed here and forwarded to the libc internals.
+ * GSlice is told to go through malloc too.
+ */
+#ifdef __GLIBC__
+
+#define HAVE_ALLOC_COUNTER 1
+
+extern void *__libc_malloc   (size_t size);
+extern void *__libc_calloc   (size_t n_elements, size_t size);
+extern void *__libc_realloc  (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static guint64 n_allocations = 0;
+
+#define COUNT_ALLOCATION() \
+  __atomic_fetch_add (&n_allocations, 1, __ATOMIC_RELAXED)
+
+void *
+malloc (size_t size)
+{
+  COUNT_ALLOCATION ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_elements,
+        size_t size)
+{
+  COUNT_ALLOCATION ();
+  return __libc_calloc (n_elements, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  COUNT_ALLOCATION ();
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  COUNT_ALLOCATION ();
+  return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void   **ptr,
+                size_t   alignment,
+                size_t   size)
+{
+  void *mem;
+
+  COUNT_ALLOCATION ();
+  mem = __libc_memalign (alignment, size);
+
+  if (!mem)
+    return 12; /* ENOMEM */
+
+  *ptr = mem;
+  return 0;
+}
+
+static guint64
+get_allocations (void)
+{
+  return __atomic_load_n (&n_allocations, __ATOMIC_RELAXED);
+}
+
+#else
+
+static guint64
+get_allocations (void)
+{
+  return 0;
+}
+
+#endif /* __GLIBC__ */
+
+/* Minimal object with a double property to animate */
+typedef struct BenchTarget      BenchTarget;
+typedef struct BenchTargetClass BenchTargetClass;
+
+struct BenchTarget
+{
+  GObject parent_instance;
+  gdouble value;
+};
+
+struct BenchTargetClass
+{
+  GObjectClass parent_class;
+};
+
+enum {
+  PROP_0,
+  PROP_VALUE
+};
+
+static GType bench_target_get_type (void);
+
+G_DEFINE_TYPE (BenchTarget, bench_target, G_TYPE_OBJECT)
+
+static void
+bench_target_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  switch (prop_id)
+    {
+    case PROP_VALUE:
+      ((BenchTarget *) object)->value = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bench_target_get_property (GObject    *object,
+                           guint       prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  switch (prop_id)
+    {
+    case PROP_VALUE:
+      g_value_set_double (value, ((BenchTarget *) object)->value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bench_target_class_init (BenchTargetClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->set_property = bench_target_set_property;
+  object_class->get_property = bench_target_get_property;
+
+  g_object_class_install_property (object_class,
+                                   PROP_VALUE,
+                                   g_param_spec_double ("value",
+                                                        "Value",
+                                                        "Value",
+                                                        -G_MAXDOUBLE,
+                                                        G_MAXDOUBLE,
+                                                        0.,
+                                                        G_PARAM_READWRITE));
+}
+
+static void
+bench_target_init (BenchTarget *target)
+{
+}
+
+/* Benchmark runner. A benchmark runs @n_iterations operations
+ * between bench_start() and bench_stop(), setup outside those
+ * is not measured, and several start/stop pairs add up. The
+ * iteration count doubles until a run takes MIN_TIME_USEC.
+ */
+typedef struct Bench Bench;
+
+typedef void (* BenchFunc) (Bench    *bench,
+                            guint64   n_iterations,
+                            gpointer  data);
+
+struct Bench
+{
+  gint64 start_time;
+  guint64 start_allocations;
+
+  gint64 elapsed;
+  guint64 allocations;
+
+  /* operations done, if not n_iterations */
+  guint64 n_ops;
+};
+
+static const gchar *filter = NULL;
+
+static void
+bench_start (Bench *bench)
+{
+  bench->start_allocations = get_allocations ();
+  bench->start_time = g_get_monotonic_time ();
+}
+
+static void
+bench_stop (Bench *bench)
+{
+  bench->elapsed += g_get_monotonic_time () - bench->start_time;
+  bench->allocations += get_allocations () - bench->start_allocations;
+}
+
+static void
+bench_run (const gchar *name,
+           BenchFunc    func,
+           gpointer     data)
+{
+  Bench bench;
+  guint64 n_iterations = 1;
+  gdouble n_ops;
+
+  if (filter && !strstr (name, filter))
+    return;
+
+  while (TRUE)
+    {
+      memset (&bench, 0, sizeof (Bench));
+      (func) (&bench, n_iterations, data);
+
+      if (bench.elapsed >= MIN_TIME_USEC ||
+          n_iterations >= G_MAXUINT32)
+        break;
+
+      n_iterations *= 2;
+    }
+
+  n_ops = (bench.n_ops) ? bench.n_ops : n_iterations;
+
+#ifdef HAVE_ALLOC_COUNTER
+  g_print ("{\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+           ", \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}\n",
+           name, n_iterations,
+           bench.elapsed * 1000. / n_ops,
+           bench.allocations / n_ops);
+#else
+  g_print ("{\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+           ", \"ns_per_op\": %.2f, \"allocs_per_op\": -1}\n",
+           name, n_iterations,
+           bench.elapsed * 1000. / n_ops);
+#endif
+}
+
+/* Animator frames: one operation is one frame of a looping
+ * animator, with all transitions active at once.
+ */
+typedef struct
+{
+  guint n_transitions;
+  gboolean locations;
+  gboolean parallel;
+  gboolean keyframes;
+} FrameParams;
+
+#define N_KEYFRAMES 8
+
+static void
+bench_frame (Bench    *bench,
+             guint64   n_iterations,
+             gpointer  data)
+{
+  FrameParams *params = data;
+  AfKeyframe keyframes[N_KEYFRAMES];
+  BenchTarget **targets = NULL;
+  gdouble *values = NULL;
+  AfClock *clock;
+  guint64 i;
+  guint id;
+
+  clock = af_manual_clock_new ();
+  id = af_animator_add ();
+  af_animator_set_clock (id, clock);
+  af_animator_set_parallel (id, params->parallel);
+
+  if (params->locations)
+    {
+      values = g_new0 (gdouble, params->n_transitions);
+
+      for (i = 0; i < params->n_transitions; i++)
+        af_animator_add_location_transition (id, 0., 1.,
+                                             AF_TIMELINE_PROGRESS_SINUSOIDAL,
+                                             NULL, NULL,
+                                             G_TYPE_DOUBLE, &values[i], (gdouble) i,
+                                             G_TYPE_INVALID);
+    }
+  else
+    {
+      targets = g_new (BenchTarget *, params->n_transitions);
+
+      for (i = 0; i < params->n_transitions; i++)
+        {
+          targets[i] = g_object_new (bench_target_get_type (), NULL);
+
+          if (params->keyframes)
+            {
+              guint k;
+
+              for (k = 0; k < N_KEYFRAMES; k++)
+                {
+                  keyframes[k].progress = (gdouble) k / (N_KEYFRAMES - 1);
+                  keyframes[k].value = (gdouble) (i + k);
+                  keyframes[k].type = AF_TIMELINE_PROGRESS_SINUSOIDAL;
+                }
+
+              af_animator_add_keyframe_transition (id, G_OBJECT (targets[i]), "value",
+                                                   keyframes, N_KEYFRAMES);
+            }
+          else
+            af_animator_add_transition (id, 0., 1.,
+                                        AF_TIMELINE_PROGRESS_SINUSOIDAL,
+                                        G_OBJECT (targets[i]),
+                                        "value", (gdouble) i,
+                                        NULL);
+        }
+    }
+
+  af_animator_start (id, LONG_DURATION);
+  af_animator_set_loop (id, TRUE);
+
+  /* first frame captures the initial values */
+  af_manual_clock_advance (clock, FRAME_USEC);
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    af_manual_clock_advance (clock, FRAME_USEC);
+
+  bench_stop (bench);
+
+  af_animator_remove (id);
+  g_object_unref (clock);
+
+  if (targets)
+    {
+      for (i = 0; i < params->n_transitions; i++)
+        g_object_unref (targets[i]);
+
+      g_free (targets);
+    }
+
+  g_free (values);
+}
+
+/* Markers */
+static gchar **
+marker_names_new (guint n_markers)
+{
+  gchar **names;
+  guint i;
+
+  names = g_new0 (gchar *, n_markers + 1);
+
+  for (i = 0; i < n_markers; i++)
+    names[i] = g_strdup_printf ("marker-%u", i);
+
+  return names;
+}
+
+/* out of order progress, so insertions don't always append */
+static gdouble
+marker_progress (guint i,
+                 guint n_markers)
+{
+  return (gdouble) ((i * 7919) % n_markers) / n_markers;
+}
+
+/* one operation adds N_MARKERS markers one by one */
+static void
+bench_marker_add (Bench    *bench,
+                  guint64   n_iterations,
+                  gpointer  data)
+{
+  gchar **names;
+  guint64 i;
+  guint j;
+
+  names = marker_names_new (N_MARKERS);
+  bench->n_ops = n_iterations * N_MARKERS;
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      AfTimeline *timeline;
+
+      timeline = af_timeline_new (1000);
+
+      bench_start (bench);
+
+      for (j = 0; j < N_MARKERS; j++)
+        af_timeline_add_marker (timeline, names[j],
+                                marker_progress (j, N_MARKERS));
+
+      bench_stop (bench);
+      g_object_unref (timeline);
+    }
+
+  g_strfreev (names);
+}
+
+static AfTimeline *
+marker_timeline_new (guint    duration,
+                     gchar  **names)
+{
+  AfTimeline *timeline;
+  guint i;
+
+  timeline = af_timeline_new (duration);
+
+  for (i = 0; i < N_MARKERS; i++)
+    af_timeline_add_marker (timeline, names[i],
+                            marker_progress (i, N_MARKERS));
+
+  return timeline;
+}
+
+static void
+bench_marker_lookup (Bench    *bench,
+                     guint64   n_iterations,
+                     gpointer  data)
+{
+  AfTimeline *timeline;
+  gchar **names;
+  guint64 i;
+  guint found = 0;
+
+  names = marker_names_new (N_MARKERS);
+  timeline = marker_timeline_new (1000, names);
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    found += af_timeline_has_marker (timeline, names[(i * 31) % N_MARKERS]);
+
+  bench_stop (bench);
+
+  g_assert (found == n_iterations);
+
+  g_object_unref (timeline);
+  g_strfreev (names);
+}
+
+static void
+marker_cb (AfTimeline  *timeline,
+           gdouble      progress,
+           const gchar *marker_name,
+           gpointer     user_data)
+{
+  guint64 *n_emitted = user_data;
+
+  (*n_emitted)++;
+}
+
+/* one operation is one emitted marker, the
+ * looping timeline runs one second per frame.
+ */
+static void
+bench_marker_emit (Bench    *bench,
+                   guint64   n_iterations,
+                   gpointer  data)
+{
+  AfTimeline *timeline;
+  AfClock *clock;
+  gchar **names;
+  guint64 n_emitted = 0;
+  guint64 i;
+
+  names = marker_names_new (N_MARKERS);
+  timeline = marker_timeline_new (N_MARKERS, names);
+  af_timeline_set_loop (timeline, TRUE);
+
+  clock = af_manual_clock_new ();
+  af_timeline_set_clock (timeline, clock);
+
+  g_signal_connect (timeline, "marker",
+                    G_CALLBACK (marker_cb), &n_emitted);
+
+  af_timeline_start (timeline);
+  af_manual_clock_advance (clock, FRAME_USEC);
+  n_emitted = 0;
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    af_manual_clock_advance (clock, G_USEC_PER_SEC);
+
+  bench_stop (bench);
+
+  bench->n_ops = MAX (n_emitted, 1);
+
+  af_timeline_stop (timeline);
+  g_object_unref (timeline);
+  g_object_unref (clock);
+  g_strfreev (names);
+}
+
+/* Easing: one operation is one eased value */
+static gdouble *
+easing_values_new (void)
+{
+  gdouble *values;
+  guint i;
+
+  values = g_new (gdouble, N_EASING_VALUES);
+
+  for (i = 0; i < N_EASING_VALUES; i++)
+    values[i] = (gdouble) i / (N_EASING_VALUES - 1);
+
+  return values;
+}
+
+static void
+bench_easing (Bench    *bench,
+              guint64   n_iterations,
+              gpointer  data)
+{
+  AfTimelineProgressType type = GPOINTER_TO_INT (data);
+  volatile gdouble sink;
+  gdouble *values, sum = 0.;
+  guint64 i;
+
+  values = easing_values_new ();
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    sum += af_timeline_calculate_progress (values[i % N_EASING_VALUES], type);
+
+  bench_stop (bench);
+
+  sink = sum;
+  (void) sink;
+
+  g_free (values);
+}
+
+static void
+bench_easing_batch (Bench    *bench,
+                    guint64   n_iterations,
+                    gpointer  data)
+{
+  AfTimelineProgressType type = GPOINTER_TO_INT (data);
+  AfTimelineProgressType *types;
+  gdouble *values, *progress;
+  guint64 i;
+
+  values = easing_values_new ();
+  progress = g_new (gdouble, N_EASING_VALUES);
+  types = g_new (AfTimelineProgressType, N_EASING_VALUES);
+
+  for (i = 0; i < N_EASING_VALUES; i++)
+    types[i] = type;
+
+  bench->n_ops = n_iterations * N_EASING_VALUES;
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    af_timeline_calculate_progress_batch (values, types, progress,
+                                          N_EASING_VALUES);
+
+  bench_stop (bench);
+
+  g_free (types);
+  g_free (progress);
+  g_free (values);
+}
+
+/* Animator churn: one operation creates a tween and removes it */
+static void
+bench_tween_churn (Bench    *bench,
+                   guint64   n_iterations,
+                   gpointer  data)
+{
+  BenchTarget *target;
+  guint64 i;
+
+  target = g_object_new (bench_target_get_type (), NULL);
+
+  bench_start (bench);
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      guint id;
+
+      id = af_animator_tween (G_OBJECT (target), 100,
+                              AF_TIMELINE_PROGRESS_LINEAR,
+                              NULL, NULL, NULL,
+                              "value", 1.,
+                              NULL);
+      af_animator_remove (id);
+    }
+
+  bench_stop (bench);
+
+  g_object_unref (target);
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const guint frame_sizes[] = { 10, 1000, 100000 };
+  GEnumClass *enum_class;
+  gchar *name;
+  guint i;
+
+  /* must happen before GSlice is first used */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+#endif
+
+  /* no display is needed */
+  gtk_init_check (&argc, &argv);
+
+  if (argc > 1)
+    filter = argv[1];
+
+  for (i = 0; i < G_N_ELEMENTS (frame_sizes); i++)
+    {
+      FrameParams params = { frame_sizes[i], FALSE, FALSE, FALSE };
+
+      name = g_strdup_printf ("frame/properties/%u", params.n_transitions);
+      bench_run (name, bench_frame, &params);
+      g_free (name);
+
+      params.keyframes = TRUE;
+      name = g_strdup_printf ("frame/keyframes/%u", params.n_transitions);
+      bench_run (name, bench_frame, &params);
+      g_free (name);
+      params.keyframes = FALSE;
+
+      params.locations = TRUE;
+      name = g_strdup_printf ("frame/locations/%u", params.n_transitions);
+      bench_run (name, bench_frame, &params);
+      g_free (name);
+
+      params.parallel = TRUE;
+      name = g_strdup_printf ("frame/locations-parallel/%u", params.n_transitions);
+      bench_run (name, bench_frame, &params);
+      g_free (name);
+    }
+
+  name = g_strdup_printf ("markers/add/%u", N_MARKERS);
+  bench_run (name, bench_marker_add, NULL);
+  g_free (name);
+
+  name = g_strdup_printf ("markers/lookup/%u", N_MARKERS);
+  bench_run (name, bench_marker_lookup, NULL);
+  g_free (name);
+
+  name = g_strdup_printf ("markers/emit/%u", N_MARKERS);
+  bench_run (name, bench_marker_emit, NULL);
+  g_free (name);
+
+  enum_class = g_type_class_ref (AF_TYPE_TIMELINE_PROGRESS_TYPE);
+
+  for (i = 0; i < enum_class->n_values; i++)
+    {
+      GEnumValue *value = &enum_class->values[i];
+
+      name = g_strdup_printf ("easing/%s", value->value_nick);
+      bench_run (name, bench_easing, GINT_TO_POINTER (value->value));
+      g_free (name);
+
+      name = g_strdup_printf ("easing-batch/%s", value->value_nick);
+      bench_run (name, bench_easing_batch, GINT_TO_POINTER (value->value));
+      g_free (name);
+    }
+
+  g_type_class_unref (enum_class);
+
+  bench_run ("animator/tween-churn", bench_tween_churn, NULL);
+
+  return 0;
+}
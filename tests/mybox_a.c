@@ -737,8 +737,8 @@ my_box_handle_animation (MyBox *box)
     {
       priv->timeline = af_timeline_new (650);
 
-      g_signal_connect (priv->timeline, "frame",
-		        G_CALLBACK (my_box_animation_frame_cb), box);
+      af_timeline_add_frame_func (priv->timeline,
+				  my_box_animation_frame_cb, box, NULL);
       
       g_signal_connect (priv->timeline, "finished",
 		        G_CALLBACK (my_box_animation_finished_cb), 
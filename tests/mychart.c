@@ -306,7 +306,7 @@ my_chart_trans (const GValue *from,
 	        const GValue *to,
 	        gdouble       progress,
 		gpointer      user_data,
-		GValue       *out_value)
+		gpointer      out_boxed)
 {
   MyChartPoint *pfrom, *pto, *res;
   gdouble d, dl, m, t_square_end;
@@ -318,7 +318,7 @@ my_chart_trans (const GValue *from,
   pfrom = g_value_get_boxed (from);
   pto = g_value_get_boxed (to);
 
-  res = g_slice_new (MyChartPoint);
+  res = out_boxed;
 
   dl = (pto->y - pfrom->y) / 2;
 
@@ -332,8 +332,6 @@ my_chart_trans (const GValue *from,
       
       res->y = pto->y - ABS((-d * dl * t_square_end * progress * progress) / m);
     }  
-      
-  g_value_set_boxed (out_value, res);
 }
 
 /* box MyChartPoint */
@@ -50,6 +50,6 @@ void my_chart_trans (const GValue *from,
  	             const GValue *to,
 	             gdouble       progress,
 		     gpointer      user_data,
-		     GValue       *out_value);
+		     gpointer      out_boxed);
 
 #endif /* __MY_CHART_H__ */
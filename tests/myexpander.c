@@ -595,8 +595,8 @@ my_expander_handle_animation (MyExpander *expander)
     {
       priv->timeline = af_timeline_new (650);
 
-      g_signal_connect (priv->timeline, "frame",
-		        G_CALLBACK (my_expander_animation_frame_cb), expander);
+      af_timeline_add_frame_func (priv->timeline,
+				  my_expander_animation_frame_cb, expander, NULL);
       
       g_signal_connect (priv->timeline, "finished",
 		        G_CALLBACK (my_expander_animation_finished_cb), 
@@ -540,8 +540,8 @@ my_vbox_handle_animation (MyVBox *vbox)
     {
       priv->timeline = af_timeline_new (650);
 
-      g_signal_connect (priv->timeline, "frame",
-		        G_CALLBACK (my_vbox_animation_frame_cb), vbox);
+      af_timeline_add_frame_func (priv->timeline,
+				  my_vbox_animation_frame_cb, vbox, NULL);
       
       g_signal_connect (priv->timeline, "finished",
 		        G_CALLBACK (my_vbox_animation_finished_cb), 
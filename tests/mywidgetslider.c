@@ -159,8 +159,8 @@ my_slider_handle_animation (MySlider *slider)
     {
       priv->timeline = af_timeline_new (650);
 
-      g_signal_connect (priv->timeline, "frame",
-		        G_CALLBACK (my_slider_animation_frame_cb), slider);
+      af_timeline_add_frame_func (priv->timeline,
+				  my_slider_animation_frame_cb, slider, NULL);
       
       g_signal_connect (priv->timeline, "finished",
 		        G_CALLBACK (my_slider_animation_finished_cb), 
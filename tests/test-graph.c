@@ -41,7 +41,7 @@ play_cb (GtkButton *button,
 		              2000,
 			      AF_TIMELINE_PROGRESS_LINEAR,
 			      NULL, NULL, free_id,
-			      "point", &end, my_chart_trans,
+			      "point", &end, NULL,
 			      NULL);
     }
   else
@@ -101,10 +101,8 @@ int main( int   argc,
 
   gtk_widget_show_all (window);
 
-  /*
-  af_animator_register_type_transformation (MY_CHART_TYPE_POINT,
-		                            my_chart_trans);
-  */
+  af_animator_register_type_transformation_in_place (MY_CHART_TYPE_POINT,
+		                                     my_chart_trans);
 
   gtk_main ();
     